@@ -3,11 +3,15 @@
 //
 
 #include "Model.h"
+#include "profiler.h"
+#include <algorithm>
 #include <fstream>
+#include <queue>
 #include <sstream>
 
 // 캯.objļ·
-Model::Model(const std::string filename) {
+Model::Model(const std::string filename, const int nlods, const bool compressed) {
+    PROFILE_SCOPE("Model::Model");
     std::ifstream in;
     in.open(filename, std::ifstream::in); // .objļ
     if (in.fail()) return;
@@ -52,24 +56,334 @@ Model::Model(const std::string filename) {
             }
         }
     }
+    lod_faces = {0, static_cast<int>(facet_vrt.size() / 3)};
     // 
     std::cerr << "# v# " << nverts() << " f# " << nfaces() << std::endl;
 
-    auto load_texture = [&filename](const std::string suffix, TGAImage &img) {
+    auto load_texture = [&filename, compressed](const std::string suffix, const TextureFormat format, Texture &img) {
+        PROFILE_SCOPE("Model::load_texture");
         size_t dot = filename.find_last_of(".");
         if (dot == std::string::npos) return;
         std::string texfile = filename.substr(0, dot) + suffix;
-        std::cerr << "texture file " << texfile << " loading " << (img.read_tga_file(texfile.c_str()) ? "ok" : "failed")
-                  << std::endl;
+        std::cerr << "texture file " << texfile << " loading "
+                  << (img.load(texfile, compressed ? format : TextureFormat::RAW) ? "ok" : "failed") << std::endl;
     };
-    load_texture("_nm_tangent.tga", normalmap);
-    load_texture("_diffuse.tga", diffusemap);
-    load_texture("_spec.tga", specularmap);
+    load_texture("_nm_tangent.tga", TextureFormat::BC5, normalmap);
+    load_texture("_diffuse.tga", TextureFormat::BC1, diffusemap);
+    load_texture("_spec.tga", TextureFormat::BC4, specularmap);
+    compute_bounds();
+    build_lods(nlods);
+}
+
+Model::Model(const Model &mesh, const std::vector<vec3> &offsets) : norms(mesh.norms), tex(mesh.tex),
+    normalmap(mesh.normalmap), diffusemap(mesh.diffusemap), specularmap(mesh.specularmap) {
+    for (const vec3 &offset: offsets) {
+        const int base = verts.size();
+        for (const vec4 &v: mesh.verts)
+            verts.push_back(v + vec4{offset.x, offset.y, offset.z, 0});
+        for (int i = 0; i < mesh.nfaces() * 3; i++) // level 0 only
+            facet_vrt.push_back(base + mesh.facet_vrt[i]);
+        facet_nrm.insert(facet_nrm.end(), mesh.facet_nrm.begin(), mesh.facet_nrm.begin() + mesh.nfaces() * 3);
+        facet_tex.insert(facet_tex.end(), mesh.facet_tex.begin(), mesh.facet_tex.begin() + mesh.nfaces() * 3);
+    }
+    lod_faces = {0, static_cast<int>(facet_vrt.size() / 3)};
+    compute_bounds();
+}
+
+void Model::compute_bounds() {
+    if (verts.empty()) return;
+    vec3 lo = verts[0].xyz(), hi = lo;
+    for (const vec4 &v: verts)
+        for (int i: {0, 1, 2}) {
+            lo[i] = std::min(lo[i], v[i]);
+            hi[i] = std::max(hi[i], v[i]);
+        }
+    bounds_center = (lo + hi) / 2.;
+    bounds_radius = 0;
+    for (const vec4 &v: verts)
+        bounds_radius = std::max(bounds_radius, norm(v.xyz() - bounds_center));
+}
+
+// symmetric 4x4 matrix of the squared distances to a set of planes (Garland & Heckbert), upper triangle only
+struct Quadric {
+    double a[10] = {};
+    double weight = 0;
+
+    void add_plane(const vec3 &n, const double d, const double w) {
+        const double p[4] = {n.x, n.y, n.z, d};
+        for (int i = 0, k = 0; i < 4; i++)
+            for (int j = i; j < 4; j++)
+                a[k++] += w * p[i] * p[j];
+        weight += w;
+    }
+
+    void add(const Quadric &q) {
+        for (int i = 0; i < 10; i++) a[i] += q.a[i];
+        weight += q.weight;
+    }
+
+    double error(const vec3 &p) const { // mean squared distance from p to the planes
+        if (weight <= 0) return 0;
+        return (a[0] * p.x * p.x + 2 * a[1] * p.x * p.y + 2 * a[2] * p.x * p.z + 2 * a[3] * p.x
+               + a[4] * p.y * p.y + 2 * a[5] * p.y * p.z + 2 * a[6] * p.y
+               + a[7] * p.z * p.z + 2 * a[8] * p.z + a[9]) / weight;
+    }
+};
+
+// distance from p to the triangle abc: closest point by Voronoi region of the triangle (Ericson, RTCD 5.1.5)
+static double point_triangle_distance(const vec3 &p, const vec3 &a, const vec3 &b, const vec3 &c) {
+    const vec3 ab = b - a, ac = c - a, ap = p - a, bp = p - b, cp = p - c;
+    const double d1 = ab * ap, d2 = ac * ap;
+    if (d1 <= 0 && d2 <= 0) return norm(ap);
+    const double d3 = ab * bp, d4 = ac * bp;
+    if (d3 >= 0 && d4 <= d3) return norm(bp);
+    const double vc = d1 * d4 - d3 * d2;
+    if (vc <= 0 && d1 >= 0 && d3 <= 0) return norm(ap - ab * (d1 / (d1 - d3)));
+    const double d5 = ab * cp, d6 = ac * cp;
+    if (d6 >= 0 && d5 <= d6) return norm(cp);
+    const double vb = d5 * d2 - d1 * d6;
+    if (vb <= 0 && d2 >= 0 && d6 <= 0) return norm(ap - ac * (d2 / (d2 - d6)));
+    const double va = d3 * d6 - d5 * d4;
+    if (va <= 0 && d4 >= d3 && d5 >= d6) return norm(bp - (c - b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6))));
+    return norm(ap - ab * (vb / (va + vb + vc)) - ac * (vc / (va + vb + vc)));
+}
+
+// candidate half-edge collapse u => v, stale as soon as u or v has changed since it was queued
+struct Collapse {
+    double cost;
+    int u, v;
+    int u_version, v_version;
+
+    bool operator>(const Collapse &c) const { return cost > c.cost; }
+};
+
+// Half-edge collapses only: u is merged into its neighbour v, no new vertex nor new attribute is created, so the
+// coarse faces keep indexing verts, tex and norms. A corner is a (uv, normal) pair: a vertex with two of them lies on
+// a UV seam, it may only slide along the seam so that both sides stay glued; three or more => locked.
+void Model::build_lods(const int nlods) {
+    if (nlods < 2 || !nfaces()) return;
+    PROFILE_SCOPE("Model::build_lods");
+    const int nv = nverts();
+    std::vector<int> fv(facet_vrt.begin(), facet_vrt.begin() + nfaces() * 3);
+    std::vector<int> ft(facet_tex.begin(), facet_tex.begin() + nfaces() * 3);
+    std::vector<int> fn(facet_nrm.begin(), facet_nrm.begin() + nfaces() * 3);
+    std::vector<char> face_alive(nfaces(), 1);
+    std::vector<std::vector<int>> vfaces(nv); // faces around each vertex, dead ones included
+    for (int f = 0; f < nfaces(); f++)
+        for (int k: {0, 1, 2}) vfaces[fv[f * 3 + k]].push_back(f);
+
+    auto pos = [this](const int v) { return verts[v].xyz(); };
+    auto face_normal = [&](const int a, const int b, const int c) { return cross(pos(b) - pos(a), pos(c) - pos(a)); };
+
+    // borders (one face per edge) collapse along themselves only, non-manifold edges are frozen
+    std::vector<char> border(nv, 0), locked(nv, 0);
+    std::vector<Quadric> quadrics(nv);
+    {
+        std::vector<std::pair<std::pair<int, int>, int>> edges; // (sorted edge, face)
+        for (int f = 0; f < nfaces(); f++)
+            for (int k: {0, 1, 2}) {
+                const int a = fv[f * 3 + k], b = fv[f * 3 + (k + 1) % 3];
+                edges.push_back({{std::min(a, b), std::max(a, b)}, f});
+            }
+        std::sort(edges.begin(), edges.end());
+        for (size_t i = 0, j; i < edges.size(); i = j) {
+            for (j = i; j < edges.size() && edges[j].first == edges[i].first; j++);
+            const auto [a, b] = edges[i].first;
+            if (j - i > 2) locked[a] = locked[b] = 1;
+            if (j - i != 1) continue;
+            border[a] = border[b] = 1;
+            const int f = edges[i].second; // plane through the border edge, orthogonal to its face => keeps the outline
+            const vec3 n = normalized(cross(pos(b) - pos(a), face_normal(fv[f * 3], fv[f * 3 + 1], fv[f * 3 + 2])));
+            quadrics[a].add_plane(n, -(n * pos(a)), 10);
+            quadrics[b].add_plane(n, -(n * pos(a)), 10);
+        }
+    }
+    for (int f = 0; f < nfaces(); f++) {
+        const vec3 n = face_normal(fv[f * 3], fv[f * 3 + 1], fv[f * 3 + 2]);
+        if (norm(n) == 0) continue;
+        const vec3 u = normalized(n);
+        for (int k: {0, 1, 2}) quadrics[fv[f * 3 + k]].add_plane(u, -(u * pos(fv[f * 3])), 1);
+    }
+    for (int v = 0; v < nv; v++) {
+        std::vector<std::pair<int, int>> corners;
+        for (const int f: vfaces[v])
+            for (int k: {0, 1, 2})
+                if (fv[f * 3 + k] == v) corners.push_back({ft[f * 3 + k], fn[f * 3 + k]});
+        std::sort(corners.begin(), corners.end());
+        if (std::unique(corners.begin(), corners.end()) - corners.begin() > 2) locked[v] = 1;
+    }
+
+    std::vector<int> version(nv, 0);
+    std::vector<char> vert_alive(nv, 1);
+    std::vector<int> merged_into(nv); // u => v of the collapse that removed u, followed until an alive vertex
+    for (int v = 0; v < nv; v++) merged_into[v] = v;
+    std::priority_queue<Collapse, std::vector<Collapse>, std::greater<Collapse>> queue;
+    auto push = [&](const int u, const int v) {
+        if (locked[u]) return;
+        Quadric q = quadrics[u];
+        q.add(quadrics[v]);
+        queue.push({std::max(q.error(pos(v)), 0.), u, v, version[u], version[v]});
+    };
+    auto push_around = [&](const int v) { // both directions of every edge around v
+        for (const int f: vfaces[v]) {
+            if (!face_alive[f]) continue;
+            for (int k: {0, 1, 2}) {
+                const int w = fv[f * 3 + k];
+                if (w == v) continue;
+                push(v, w);
+                push(w, v);
+            }
+        }
+    };
+    for (int f = 0; f < nfaces(); f++)
+        for (int k: {0, 1, 2}) push(fv[f * 3 + k], fv[f * 3 + (k + 1) % 3]), push(fv[f * 3 + (k + 1) % 3], fv[f * 3 + k]);
+
+    // checks the collapse u => v, fills the mapping from the corners of u to those of v
+    std::vector<std::pair<std::pair<int, int>, std::pair<int, int>>> remap;
+    std::vector<int> nu, nvv;
+    auto valid = [&](const int u, const int v) {
+        remap.clear();
+        nu.clear();
+        nvv.clear();
+        int shared = 0;
+        for (const int f: vfaces[u]) {
+            if (!face_alive[f]) continue;
+            int ku = 0, kv = -1;
+            for (int k: {0, 1, 2}) {
+                if (fv[f * 3 + k] == u) ku = k;
+                else if (fv[f * 3 + k] == v) kv = k;
+                else nu.push_back(fv[f * 3 + k]);
+            }
+            const std::pair<int, int> cu = {ft[f * 3 + ku], fn[f * 3 + ku]};
+            if (kv < 0) continue;
+            shared++;
+            const std::pair<int, int> cv = {ft[f * 3 + kv], fn[f * 3 + kv]};
+            auto it = std::find_if(remap.begin(), remap.end(), [&cu](const auto &m) { return m.first == cu; });
+            if (it == remap.end()) remap.push_back({cu, cv});
+            else if (it->second != cv) return false; // u's corner would get two different attributes
+        }
+        if (!shared || (border[u] && shared != 1)) return false; // a border vertex only moves along its border
+        for (const int f: vfaces[u]) { // every corner of u must have a counterpart on v, no fold-over
+            if (!face_alive[f]) continue;
+            int ku = 0;
+            bool has_v = false;
+            for (int k: {0, 1, 2}) {
+                if (fv[f * 3 + k] == u) ku = k;
+                if (fv[f * 3 + k] == v) has_v = true;
+            }
+            const std::pair<int, int> cu = {ft[f * 3 + ku], fn[f * 3 + ku]};
+            if (std::none_of(remap.begin(), remap.end(), [&cu](const auto &m) { return m.first == cu; }))
+                return false;
+            if (has_v) continue;
+            const int a = fv[f * 3], b = fv[f * 3 + 1], c = fv[f * 3 + 2];
+            const vec3 before = face_normal(a, b, c);
+            const vec3 after = face_normal(a == u ? v : a, b == u ? v : b, c == u ? v : c);
+            if (before * after <= 1e-3 * norm(before) * norm(after)) return false;
+        }
+        // link condition: u and v must have exactly the neighbours of the faces they share in common
+        for (const int f: vfaces[v]) {
+            if (!face_alive[f]) continue;
+            for (int k: {0, 1, 2})
+                if (fv[f * 3 + k] != v && fv[f * 3 + k] != u) nvv.push_back(fv[f * 3 + k]);
+        }
+        std::sort(nu.begin(), nu.end());
+        nu.erase(std::unique(nu.begin(), nu.end()), nu.end());
+        std::sort(nvv.begin(), nvv.end());
+        nvv.erase(std::unique(nvv.begin(), nvv.end()), nvv.end());
+        int common = 0;
+        for (size_t i = 0, j = 0; i < nu.size() && j < nvv.size();) {
+            if (nu[i] < nvv[j]) i++;
+            else if (nvv[j] < nu[i]) j++;
+            else common++, i++, j++;
+        }
+        return common == shared;
+    };
+
+    int nalive = nfaces();
+    double max_error = 0; // of the levels built so far, the chain is only ever coarser
+    for (int level = 1; level < nlods; level++) {
+        const int target = nalive / 2;
+        while (nalive > target && !queue.empty()) {
+            const Collapse c = queue.top();
+            queue.pop();
+            if (!vert_alive[c.u] || !vert_alive[c.v] || c.u_version != version[c.u] || c.v_version != version[c.v])
+                continue;
+            if (!valid(c.u, c.v)) continue;
+            for (const int f: vfaces[c.u]) {
+                if (!face_alive[f]) continue;
+                bool has_v = false;
+                for (int k: {0, 1, 2}) has_v |= fv[f * 3 + k] == c.v;
+                if (has_v) { // degenerated
+                    face_alive[f] = 0;
+                    nalive--;
+                    continue;
+                }
+                for (int k: {0, 1, 2}) {
+                    if (fv[f * 3 + k] != c.u) continue;
+                    const std::pair<int, int> cu = {ft[f * 3 + k], fn[f * 3 + k]};
+                    const auto &m = *std::find_if(remap.begin(), remap.end(), [&cu](const auto &m) { return m.first == cu; });
+                    fv[f * 3 + k] = c.v;
+                    ft[f * 3 + k] = m.second.first;
+                    fn[f * 3 + k] = m.second.second;
+                }
+                vfaces[c.v].push_back(f);
+            }
+            vert_alive[c.u] = 0;
+            merged_into[c.u] = c.v;
+            quadrics[c.v].add(quadrics[c.u]);
+            version[c.v]++;
+            push_around(c.v);
+        }
+        if (nalive == lod_faces.back() - lod_faces[lod_faces.size() - 2]) break; // nothing left to collapse
+        for (int f = 0; f < nfaces(); f++) {
+            if (!face_alive[f]) continue;
+            facet_vrt.insert(facet_vrt.end(), fv.begin() + f * 3, fv.begin() + f * 3 + 3);
+            facet_tex.insert(facet_tex.end(), ft.begin() + f * 3, ft.begin() + f * 3 + 3);
+            facet_nrm.insert(facet_nrm.end(), fn.begin() + f * 3, fn.begin() + f * 3 + 3);
+        }
+        lod_faces.push_back(facet_vrt.size() / 3);
+        // the quadric costs only rank the collapses; the error of the level is a distance: the farthest a removed
+        // vertex of the mesh lies from the coarse faces around the vertex it was merged into, an upper bound of its
+        // distance to the coarse surface
+        for (int u = 0; u < nv; u++) {
+            int v = merged_into[u];
+            while (!vert_alive[v]) v = merged_into[v];
+            merged_into[u] = v;
+            if (v == u) continue;
+            double distance = -1;
+            for (const int f: vfaces[v]) {
+                if (!face_alive[f]) continue;
+                const double d = point_triangle_distance(pos(u), pos(fv[f * 3]), pos(fv[f * 3 + 1]), pos(fv[f * 3 + 2]));
+                if (distance < 0 || d < distance) distance = d;
+            }
+            max_error = std::max(max_error, distance);
+        }
+        lod_errors.push_back(max_error);
+        std::cerr << "# LOD " << level << " f# " << nalive << " error " << lod_errors.back() << std::endl;
+    }
 }
 
 int Model::nverts() const { return verts.size(); }
 
-int Model::nfaces() const { return facet_vrt.size() / 3; }
+int Model::nfaces() const { return lod_faces[1]; }
+
+int Model::nlods() const { return lod_errors.size(); }
+
+int Model::lod_begin(const int level) const { return lod_faces[level]; }
+
+int Model::lod_end(const int level) const { return lod_faces[level + 1]; }
+
+double Model::lod_error(const int level) const { return lod_errors[level]; }
+
+int Model::select_lod(const double pixels_per_unit, const double tolerance) const {
+    int level = 0;
+    while (level + 1 < nlods() && lod_errors[level + 1] * pixels_per_unit < tolerance) level++;
+    return level;
+}
+
+vec3 Model::center() const { return bounds_center; }
+
+double Model::radius() const { return bounds_radius; }
 
 vec4 Model::vert(const int i) const {
     return verts[i];
@@ -92,6 +406,10 @@ vec2 Model::uv(const int iface, const int nthvert) const {
     return tex[facet_tex[iface * 3 + nthvert]];
 }
 
-const TGAImage &Model::diffuse() const { return diffusemap; }
+const Texture &Model::diffuse() const { return diffusemap; }
+
+const Texture &Model::specular() const { return specularmap; }
 
-const TGAImage &Model::specular() const { return specularmap; }
+size_t Model::texture_bytes() const {
+    return normalmap.bytes() + diffusemap.bytes() + specularmap.bytes();
+}
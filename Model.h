@@ -7,7 +7,7 @@
 
 #include <vector>
 #include "geometry.h"
-#include "tgaimage.h"
+#include "texture.h"
 
 class Model {
     std::vector<vec4> verts = {}; // array of vertices
@@ -17,14 +17,41 @@ class Model {
 
     std::vector<vec2> tex = {};      // array of tex coords(uv)
     std::vector<int> facet_tex = {}; // per-triangle index of tex coords
-    TGAImage normalmap = {}; // normal map texture
-    TGAImage diffusemap = {}; // diffuse map texture
-    TGAImage specularmap = {}; // specular map texture
+    std::vector<int> lod_faces = {0, 0}; // the faces of LOD level i are [lod_faces[i], lod_faces[i+1]), level 0 is the mesh
+    std::vector<double> lod_errors = {0}; // object-space distance bound of each level, see lod_error()
+    vec3 bounds_center = {}; // bounding sphere
+    double bounds_radius = 0;
+    Texture normalmap = {}; // normal map texture
+    Texture diffusemap = {}; // diffuse map texture
+    Texture specularmap = {}; // specular map texture
+
+    void compute_bounds();
+
+    void build_lods(const int nlods);
+
 public:
-    Model(const std::string filename); // .objļ·ģ
+    // with nlods > 1, coarser levels of detail are appended to the faces: quadric edge collapse, each level halving the
+    // triangle count of the previous one, UV seams and borders only collapse along themselves;
+    // compressed: the textures are stored as blocks, BC1 for the diffuse map, BC4 for the specular one, BC5 for the
+    // normal map
+    Model(const std::string filename, const int nlods = 1, const bool compressed = false); // .objļ·ģ
+
+    // copies of mesh translated by offsets, sharing its normals, uv and textures => large meshes out of the Obj/ assets
+    Model(const Model &mesh, const std::vector<vec3> &offsets);
 
     int nverts() const; // number of vertices
-    int nfaces() const; // number of triangles
+    int nfaces() const; // number of triangles of the full mesh (LOD level 0)
+
+    int nlods() const; // number of levels of detail, 1 if none was built
+    int lod_begin(const int level) const; // faces of the level: lod_begin(level) <= iface < lod_end(level)
+    int lod_end(const int level) const;
+    double lod_error(const int level) const; // farthest a removed vertex lies from the level, model units, 0 for level 0
+
+    // coarsest level whose error projects to less than tolerance pixels, given the screen size of one model unit
+    int select_lod(const double pixels_per_unit, const double tolerance = 1) const;
+
+    vec3 center() const; // bounding sphere of the mesh
+    double radius() const;
 
     vec4 vert(const int i) const; // 0 <= i < nverts() => صi
 
@@ -37,10 +64,12 @@ public:
     // normal coming from the normal map texture => ifaceεĵnthvertķԷͼ
     vec4 normal(const vec2 &uv) const;
 
-    const TGAImage &diffuse() const; // ͼuvɫ
-    const TGAImage &specular() const; // ظ߹ͼuvɫr
+    const Texture &diffuse() const; // ͼuvɫ
+    const Texture &specular() const; // ظ߹ͼuvɫr
 
     vec2 uv(const int iface, const int nthvert) const; // صifaceεĵnthvertuv
+
+    size_t texture_bytes() const; // memory taken by the three textures
 };
 
 
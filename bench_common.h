@@ -0,0 +1,81 @@
+//
+// Created by 25190 on 2026/10/18.
+//
+// shared by the benchmark executables: timing, the command line, the JSON output and image comparison.
+// usage: bench_xxx [--reps N] [--out results.json]   (run from a directory next to Obj/, like the renderer)
+//
+
+#ifndef BENCH_COMMON_H
+#define BENCH_COMMON_H
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+#include "gl_mine.h"
+
+using bench_clock = std::chrono::steady_clock;
+
+inline double elapsed_ms(const bench_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(bench_clock::now() - start).count();
+}
+
+struct BenchOptions
+{
+    int reps; // repetitions, the best one is reported
+    std::string out_path; // JSON output, stdout if empty
+};
+
+inline BenchOptions parse_options(const int argc, char **argv, const int default_reps)
+{
+    BenchOptions options = {default_reps, ""};
+    for (int i = 1; i + 1 < argc; i += 2)
+    {
+        const std::string arg = argv[i];
+        if (arg == "--reps") options.reps = std::max(1, std::atoi(argv[i + 1]));
+        else if (arg == "--out") options.out_path = argv[i + 1];
+    }
+    return options;
+}
+
+// write(out) prints the results to stdout or to the --out file
+template<class Write>
+void write_results(const BenchOptions &options, const Write &write)
+{
+    if (options.out_path.empty())
+        write(std::cout);
+    else
+    {
+        std::ofstream out(options.out_path);
+        write(out);
+    }
+}
+
+// fraction of the pixels covered in either image (depth written) whose color differs by more than tolerance
+inline double mismatch(const RenderTarget &a, const RenderTarget &b, const int tolerance = 0)
+{
+    long covered = 0, different = 0;
+    for (int y = 0; y < a.color.height(); y++)
+    {
+        for (int x = 0; x < a.color.width(); x++)
+        {
+            const int i = x + y * a.color.width();
+            if (a.depth[i] == -1000. && b.depth[i] == -1000.) continue;
+            covered++;
+            const TGAColor ca = a.color.get(x, y), cb = b.color.get(x, y);
+            for (int c: {0, 1, 2})
+                if (std::abs(ca[c] - cb[c]) > tolerance)
+                {
+                    different++;
+                    break;
+                }
+        }
+    }
+    return covered ? static_cast<double>(different) / covered : 0;
+}
+
+#endif //BENCH_COMMON_H
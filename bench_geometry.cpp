@@ -0,0 +1,111 @@
+//
+// Microbenchmarks for the geometry.h math: double templates vs the 16-byte aligned float types
+//
+
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <vector>
+#include "geometry.h"
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#endif
+
+template<typename T>
+void do_not_optimize(const T &value)
+{
+#if defined(_MSC_VER) && !defined(__clang__)
+    // no inline asm on MSVC: the address escapes into a volatile sink, so the value has to be materialized
+    static const void *volatile sink;
+    sink = &value;
+    _ReadWriteBarrier();
+#else
+    asm volatile("" : : "r,m"(value) : "memory");
+#endif
+}
+
+// runs op(i) for i in [0, n) several times and reports the best nanoseconds per call
+template<typename Op>
+double bench(const int n, Op op)
+{
+    double best = 1e30;
+    for (int rep = 0; rep < 5; rep++)
+    {
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < n; i++) op(i);
+        auto stop = std::chrono::steady_clock::now();
+        best = std::min(best, std::chrono::duration<double, std::nano>(stop - start).count() / n);
+    }
+    return best;
+}
+
+void report(const char *name, const double ns_double, const double ns_float)
+{
+    std::printf("%-24s %10.2f %10.2f %8.2fx\n", name, ns_double, ns_float, ns_double / ns_float);
+}
+
+int main()
+{
+    constexpr int n = 1 << 16;
+    std::mt19937 gen(42);
+    std::uniform_real_distribution<double> dist(-1, 1);
+
+    std::vector<vec4> vd(n);
+    std::vector<vec4f> vf(n);
+    std::vector<mat<4, 4>> md(n);
+    std::vector<mat4f> mf(n);
+    for (int i = 0; i < n; i++)
+    {
+        vd[i] = {dist(gen), dist(gen), dist(gen), dist(gen)};
+        vf[i] = vd[i];
+        for (int r = 0; r < 4; r++)
+            for (int c = 0; c < 4; c++)
+                md[i][r][c] = dist(gen) + (r == c ? 4 : 0); // diagonally dominant => invertible
+        mf[i] = md[i];
+    }
+
+    std::printf("%-24s %10s %10s %9s\n", "operation (ns/op)", "double", "float", "speedup");
+    report("vec4 + vec4",
+           bench(n, [&](int i) { do_not_optimize(vd[i] + vd[n - 1 - i]); }),
+           bench(n, [&](int i) { do_not_optimize(vf[i] + vf[n - 1 - i]); }));
+    report("vec4 * scalar",
+           bench(n, [&](int i) { do_not_optimize(vd[i] * 0.5); }),
+           bench(n, [&](int i) { do_not_optimize(vf[i] * 0.5f); }));
+    report("dot(vec4, vec4)",
+           bench(n, [&](int i) { do_not_optimize(vd[i] * vd[n - 1 - i]); }),
+           bench(n, [&](int i) { do_not_optimize(vf[i] * vf[n - 1 - i]); }));
+    report("normalized(vec4)",
+           bench(n, [&](int i) { do_not_optimize(normalized(vd[i])); }),
+           bench(n, [&](int i) { do_not_optimize(normalized(vf[i])); }));
+    report("mat4 * vec4",
+           bench(n, [&](int i) { do_not_optimize(md[i] * vd[i]); }),
+           bench(n, [&](int i) { do_not_optimize(mf[i] * vf[i]); }));
+    report("mat4 * mat4",
+           bench(n, [&](int i) { do_not_optimize(md[i] * md[n - 1 - i]); }),
+           bench(n, [&](int i) { do_not_optimize(mf[i] * mf[n - 1 - i]); }));
+    report("mat4.transpose()",
+           bench(n, [&](int i) { do_not_optimize(md[i].transpose()); }),
+           bench(n, [&](int i) { do_not_optimize(mf[i].transpose()); }));
+    report("mat4.det()",
+           bench(n, [&](int i) { do_not_optimize(md[i].det()); }),
+           bench(n, [&](int i) { do_not_optimize(mf[i].det()); }));
+    report("mat4.invert_transpose()",
+           bench(n, [&](int i) { do_not_optimize(md[i].invert_transpose()); }),
+           bench(n, [&](int i) { do_not_optimize(mf[i].invert_transpose()); }));
+
+    // sanity check: A * inverse(A) == identity for both closed-form paths
+    double err_d = 0, err_f = 0;
+    for (int i = 0; i < n; i++)
+    {
+        mat<4, 4> pd = md[i] * md[i].invert();
+        mat4f pf = mf[i] * mf[i].invert();
+        for (int r = 0; r < 4; r++)
+            for (int c = 0; c < 4; c++)
+            {
+                err_d = std::max(err_d, std::abs(pd[r][c] - (r == c)));
+                err_f = std::max<double>(err_f, std::abs(pf[r][c] - (r == c)));
+            }
+    }
+    std::printf("max |A * inverse(A) - I|: double %g, float %g\n", err_d, err_f);
+    return 0;
+}
@@ -0,0 +1,151 @@
+//
+// LOD benchmark: every level of detail of diablo3_pose at decreasing screen sizes, speed and pixel error against the
+// full mesh, plus the level select_lod() picks; results as JSON on stdout. Exits with 1 if a selected level moves the
+// silhouette by more than its 1 pixel tolerance on too many pixels.
+// usage: bench_lod [--reps N] [--out results.json], see bench_common.h
+//
+
+#include <iostream>
+#include <vector>
+
+#include "bench_common.h"
+#include "gl_mine.h"
+#include "Model.h"
+#include "shaders.h"
+
+struct LodResult
+{
+    double scale = 0; // model scale, i.e. screen size relative to the default framing
+    int level = 0;
+    int faces = 0;
+    double error_px = 0; // lod_error() projected to the screen
+    bool selected = false;
+    DrawStats stats; // best repetition
+    double total_ms = 0;
+    double mismatch = 0; // fraction of the covered pixels that differ from the full mesh
+    double silhouette_mismatch = 0; // see silhouette_mismatch()
+};
+
+// a selected level is flagged above that silhouette_mismatch(), which is not 0 even within the 1 pixel tolerance of
+// select_lod(): a few pixels of rasterization noise weigh a lot on the smallest scales
+constexpr double max_silhouette_mismatch = .05;
+
+// fraction of the pixels covered in either image whose coverage in b is not found in a within 1 pixel, i.e. that a
+// silhouette displaced by at most 1 pixel does not explain
+static double silhouette_mismatch(const RenderTarget &a, const RenderTarget &b)
+{
+    const int width = a.color.width(), height = a.color.height();
+    long covered = 0, different = 0;
+    for (int y = 0; y < height; y++)
+    {
+        for (int x = 0; x < width; x++)
+        {
+            const bool in_a = a.depth[x + y * width] != -1000., in_b = b.depth[x + y * width] != -1000.;
+            if (!in_a && !in_b) continue;
+            covered++;
+            bool found = false;
+            for (int j = std::max(0, y - 1); j <= std::min(height - 1, y + 1) && !found; j++)
+                for (int i = std::max(0, x - 1); i <= std::min(width - 1, x + 1) && !found; i++)
+                    found = (a.depth[i + j * width] != -1000.) == in_b;
+            different += !found;
+        }
+    }
+    return covered ? static_cast<double>(different) / covered : 0;
+}
+
+static void write_json(std::ostream &out, const Model &model, const double build_ms, const int reps,
+                       const std::vector<LodResult> &results)
+{
+    out << "{\n  \"model\": \"diablo3_pose\",\n  \"lod_build_ms\": " << build_ms << ",\n  \"repetitions\": " << reps
+        << ",\n  \"levels\": [";
+    for (int level = 0; level < model.nlods(); level++)
+        out << (level ? ", " : "") << "{\"faces\": " << model.lod_end(level) - model.lod_begin(level)
+            << ", \"error\": " << model.lod_error(level) << "}";
+    out << "],\n  \"results\": [\n";
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        const LodResult &r = results[i];
+        out << "    {\"scale\": " << r.scale << ", \"level\": " << r.level << ", \"faces\": " << r.faces
+            << ", \"error_px\": " << r.error_px << ", \"selected\": " << (r.selected ? "true" : "false")
+            << ", \"vertex_ms\": " << r.stats.vertex_ms
+            << ", \"raster_ms\": " << r.stats.raster_ms
+            << ", \"total_ms\": " << r.total_ms
+            << ", \"visible_triangles\": " << r.stats.visible
+            << ", \"fragments\": " << r.stats.fragments
+            << ", \"mismatch\": " << r.mismatch
+            << ", \"silhouette_mismatch\": " << r.silhouette_mismatch << "}" << (i + 1 < results.size() ? "," : "")
+            << "\n";
+    }
+    out << "  ]\n}\n";
+}
+
+int main(int argc, char **argv)
+{
+    const BenchOptions options = parse_options(argc, argv, 5);
+    const int reps = options.reps;
+
+    auto start = bench_clock::now();
+    const Model mesh("../Obj/diablo3_pose.obj");
+    const double load_ms = elapsed_ms(start);
+    start = bench_clock::now();
+    const Model model("../Obj/diablo3_pose.obj", 6);
+    const double build_ms = elapsed_ms(start) - load_ms;
+    if (!model.nfaces())
+    {
+        std::cerr << "can't load ../Obj/diablo3_pose.obj" << std::endl;
+        return 1;
+    }
+
+    constexpr int size = 800;
+    constexpr vec3 eye{-1, 0, 2};
+    constexpr vec4 color = {22 * 4, 56 * 4, 147 * 4, 255};
+    constexpr TGAColor background = {177, 195, 209, 255};
+    lookat(eye, {0, 0, 0}, {0, 1, 0});
+    init_perspective(norm(eye));
+    init_viewport(size / 16, size / 16, size * 7 / 8, size * 7 / 8);
+    const ToonShader shader(color, {1, 1, 1}, model);
+
+    std::vector<LodResult> results;
+    bool within_tolerance = true;
+    RenderTarget reference(size, size, TGAImage::RGB), target(size, size, TGAImage::RGB);
+    for (const double scale: {1., .5, .25, .125, .0625})
+    {
+        const std::vector<Instance> instances = {
+            {mat<4, 4>{{{scale, 0, 0, 0}, {0, scale, 0, 0}, {0, 0, scale, 0}, {0, 0, 0, 1}}}}
+        };
+        const double ppu = pixels_per_unit(shader.uniforms, shader.uniforms.ModelView * instances[0].transform,
+                                           model.center(), model.radius());
+        for (int level = 0; level < model.nlods(); level++)
+        {
+            LodResult best;
+            for (int rep = 0; rep < reps; rep++)
+            {
+                LodResult r;
+                r.scale = scale;
+                r.level = level;
+                r.faces = model.lod_end(level) - model.lod_begin(level);
+                r.error_px = model.lod_error(level) * ppu;
+                r.selected = level == model.select_lod(ppu);
+                RenderTarget &rt = level ? target : reference;
+                rt.clear(background);
+                start = bench_clock::now();
+                draw_instanced_range(model.lod_begin(level), model.lod_end(level), shader, instances, rt.color,
+                                     rt.depth, &r.stats);
+                r.total_ms = elapsed_ms(start);
+                if (!rep || r.total_ms < best.total_ms) best = r;
+            }
+            best.mismatch = level ? mismatch(reference, target) : 0;
+            best.silhouette_mismatch = level ? silhouette_mismatch(reference, target) : 0;
+            const bool flagged = best.selected && best.silhouette_mismatch > max_silhouette_mismatch;
+            within_tolerance &= !flagged;
+            std::cerr << "scale " << scale << " LOD " << level << (best.selected ? " (selected)" : "") << ": "
+                      << best.total_ms << " ms, " << best.error_px << " px error, " << 100 * best.mismatch
+                      << "% pixels differ, " << 100 * best.silhouette_mismatch << "% off the silhouette"
+                      << (flagged ? " -- above the tolerance" : "") << std::endl;
+            results.push_back(best);
+        }
+    }
+
+    write_results(options, [&](std::ostream &out) { write_json(out, model, build_ms, reps, results); });
+    return within_tolerance ? 0 : 1;
+}
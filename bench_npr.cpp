@@ -0,0 +1,185 @@
+//
+// NPR benchmark: the outline post-process of a diablo3_pose toon frame at increasing resolutions, the per-pixel loop
+// it replaced against the separable SIMD rows (depth edges, then depth + normal edges), the latter from 1 thread up
+// to all of them; results as JSON on stdout
+// usage: bench_npr [--reps N] [--out results.json], see bench_common.h
+//
+
+#include <iostream>
+#include <vector>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "bench_common.h"
+#include "gl_mine.h"
+#include "Model.h"
+#include "npr.h"
+#include "shaders.h"
+
+struct NprTiming
+{
+    int threads = 0;
+    double depth_ms = 0, normals_ms = 0; // best repetition
+};
+
+struct NprResult
+{
+    int resolution = 0;
+    double reference_ms = 0, depth_ms = 0, normals_ms = 0; // best repetition, all the threads
+    std::vector<NprTiming> scaling; // same with 1, 2, 4... threads
+    long edge_pixels = 0; // outlined by the reference
+    long mismatch = 0; // pixels where the depth edges differ from the reference
+    long normal_edge_pixels = 0; // added by the normal buffer
+};
+
+// the outline() of the lessons: a vec2 of doubles per tap, a sqrt per pixel, single threaded
+static void outline_reference(TGAImage &framebuffer, const std::vector<double> &depth, const double threshold = .15)
+{
+    const int width = framebuffer.width();
+    for (int y = 1; y < framebuffer.height() - 1; ++y)
+    {
+        for (int x = 1; x < framebuffer.width() - 1; ++x)
+        {
+            vec2 sum;
+            for (int j = -1; j <= 1; ++j)
+            {
+                for (int i = -1; i <= 1; ++i)
+                {
+                    constexpr int Gx[3][3] = {{-1, 0, 1}, {-2, 0, 2}, {-1, 0, 1}};
+                    constexpr int Gy[3][3] = {{-1, -2, -1}, {0, 0, 0}, {1, 2, 1}};
+                    sum = sum + vec2{
+                              Gx[j + 1][i + 1] * depth[x + i + (y + j) * width],
+                              Gy[j + 1][i + 1] * depth[x + i + (y + j) * width]
+                          };
+                }
+            }
+            if (norm(sum) > threshold)
+                framebuffer.set(x, y, TGAColor{0, 0, 0, 255});
+        }
+    }
+}
+
+static bool is_edge(const TGAImage &image, const TGAImage &frame, const int x, const int y)
+{
+    const TGAColor c = image.get(x, y), f = frame.get(x, y);
+    return !c[0] && !c[1] && !c[2] && (f[0] || f[1] || f[2]);
+}
+
+static void write_json(std::ostream &out, const int reps, const std::vector<NprResult> &results)
+{
+    out << "{\n  \"model\": \"diablo3_pose\",\n  \"repetitions\": " << reps << ",\n  \"results\": [\n";
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        const NprResult &r = results[i];
+        out << "    {\"resolution\": " << r.resolution
+            << ", \"reference_ms\": " << r.reference_ms
+            << ", \"depth_ms\": " << r.depth_ms
+            << ", \"normals_ms\": " << r.normals_ms
+            << ", \"speedup\": " << r.reference_ms / r.depth_ms
+            << ", \"threads\": [";
+        for (size_t j = 0; j < r.scaling.size(); j++)
+            out << (j ? ", " : "") << "{\"threads\": " << r.scaling[j].threads << ", \"depth_ms\": "
+                << r.scaling[j].depth_ms << ", \"normals_ms\": " << r.scaling[j].normals_ms << "}";
+        out << "]"
+            << ", \"edge_pixels\": " << r.edge_pixels
+            << ", \"mismatch\": " << r.mismatch
+            << ", \"normal_edge_pixels\": " << r.normal_edge_pixels << "}" << (i + 1 < results.size() ? "," : "")
+            << "\n";
+    }
+    out << "  ]\n}\n";
+}
+
+int main(int argc, char **argv)
+{
+    const BenchOptions options = parse_options(argc, argv, 5);
+    const int reps = options.reps;
+
+    const Model model("../Obj/diablo3_pose.obj");
+    if (!model.nfaces())
+    {
+        std::cerr << "can't load ../Obj/diablo3_pose.obj" << std::endl;
+        return 1;
+    }
+
+    int max_threads = 1;
+#ifdef _OPENMP
+    max_threads = omp_get_max_threads();
+#endif
+    std::vector<int> thread_counts;
+    for (int n = 1; n < max_threads; n *= 2) thread_counts.push_back(n);
+    thread_counts.push_back(max_threads);
+
+    constexpr vec3 eye{-1, 0, 2};
+    constexpr vec4 color = {22 * 4, 56 * 4, 147 * 4, 255};
+    std::vector<NprResult> results;
+    for (const int size: {800, 1600, 3200})
+    {
+        lookat(eye, {0, 0, 0}, {0, 1, 0});
+        init_perspective(norm(eye));
+        init_viewport(size / 16, size / 16, size * 7 / 8, size * 7 / 8);
+        RenderTarget frame(size, size, TGAImage::RGB), normals(size, size, TGAImage::RGB);
+        frame.clear({177, 195, 209, 255});
+        normals.clear({0, 0, 0, 255});
+        draw(model.nfaces(), ToonShader(color, {1, 1, 1}, model), frame.color, frame.depth);
+        draw(model.nfaces(), NormalShader(model), normals.color, normals.depth);
+
+        NprResult r;
+        r.resolution = size;
+        TGAImage reference, depth_edges, normal_edges;
+        for (int rep = 0; rep < reps; rep++) // the copies are not timed
+        {
+            reference = frame.color;
+            const auto start = bench_clock::now();
+            outline_reference(reference, frame.depth);
+            const double reference_ms = elapsed_ms(start);
+            if (!rep || reference_ms < r.reference_ms) r.reference_ms = reference_ms;
+        }
+        for (const int threads: thread_counts)
+        {
+#ifdef _OPENMP
+            omp_set_num_threads(threads);
+#endif
+            NprTiming timing;
+            timing.threads = threads;
+            for (int rep = 0; rep < reps; rep++)
+            {
+                depth_edges = frame.color;
+                auto start = bench_clock::now();
+                outline(depth_edges, frame.depth);
+                const double depth_ms = elapsed_ms(start);
+                normal_edges = frame.color;
+                start = bench_clock::now();
+                outline(normal_edges, frame.depth, normals.color);
+                const double normals_ms = elapsed_ms(start);
+                if (!rep || depth_ms < timing.depth_ms) timing.depth_ms = depth_ms;
+                if (!rep || normals_ms < timing.normals_ms) timing.normals_ms = normals_ms;
+            }
+            r.scaling.push_back(timing);
+        }
+        r.depth_ms = r.scaling.back().depth_ms;
+        r.normals_ms = r.scaling.back().normals_ms;
+        for (int y = 0; y < size; y++)
+        {
+            for (int x = 0; x < size; x++)
+            {
+                const bool edge = is_edge(reference, frame.color, x, y);
+                r.edge_pixels += edge;
+                r.mismatch += edge != is_edge(depth_edges, frame.color, x, y);
+                r.normal_edge_pixels += !edge && is_edge(normal_edges, frame.color, x, y);
+            }
+        }
+        std::cerr << size << "x" << size << ": reference " << r.reference_ms << " ms, depth edges " << r.depth_ms
+                  << " ms (x" << r.reference_ms / r.depth_ms << "), depth + normal edges " << r.normals_ms << " ms, "
+                  << r.mismatch << " pixels differ from the reference, " << r.normal_edge_pixels
+                  << " crease pixels added" << std::endl;
+        for (const NprTiming &timing: r.scaling)
+            std::cerr << "  " << timing.threads << " thread(s): depth edges " << timing.depth_ms << " ms (x"
+                      << r.scaling[0].depth_ms / timing.depth_ms << "), depth + normal edges " << timing.normals_ms
+                      << " ms (x" << r.scaling[0].normals_ms / timing.normals_ms << ")" << std::endl;
+        results.push_back(r);
+    }
+
+    write_results(options, [&](std::ostream &out) { write_json(out, reps, results); });
+    return 0;
+}
@@ -0,0 +1,183 @@
+//
+// Texture benchmark: the diablo3_pose maps raw and block-compressed (BC1 diffuse, BC4 specular, BC5 normal map):
+// memory, encoding time, PSNR, sampling throughput (random and coherent texel order) and a blinn_phong frame with
+// both models; results as JSON on stdout
+// usage: bench_texture [--reps N] [--out results.json], see bench_common.h
+//
+
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "bench_common.h"
+#include "gl_mine.h"
+#include "Model.h"
+#include "shaders.h"
+#include "texture.h"
+
+struct TextureResult
+{
+    std::string map;
+    TextureFormat format = TextureFormat::RAW;
+    int width = 0, height = 0;
+    size_t raw_bytes = 0, bytes = 0;
+    double encode_ms = 0;
+    double psnr = 0; // dB over the channels the format stores, inf if lossless
+    double raw_random_msps = 0, random_msps = 0; // millions of samples per second
+    double raw_coherent_msps = 0, coherent_msps = 0;
+};
+
+static double psnr(const TGAImage &image, const Texture &texture, const TextureFormat format)
+{
+    int first = 0, last = 2; // bgra channels compared
+    if (format == TextureFormat::BC4) last = 0;
+    if (format == TextureFormat::BC5) first = 1;
+    double se = 0;
+    long n = 0;
+    for (int y = 0; y < image.height(); y++)
+    {
+        for (int x = 0; x < image.width(); x++)
+        {
+            const TGAColor a = image.get(x, y), b = texture.get(x, y);
+            for (int c = first; c <= last; c++, n++)
+                se += (a[c] - b[c]) * (a[c] - b[c]);
+        }
+    }
+    return se ? 10 * std::log10(255. * 255. * n / se) : INFINITY;
+}
+
+// millions of samples per second through IShader::sample2D(); the checksum keeps the loop alive
+static double random_msps(const Texture &texture, const int nsamples, std::uint32_t &checksum)
+{
+    std::uint32_t state = 2463534242u; // xorshift32, same sequence for every texture
+    const auto start = bench_clock::now();
+    for (int i = 0; i < nsamples; i++)
+    {
+        vec2 uv;
+        for (int k: {0, 1})
+        {
+            state ^= state << 13;
+            state ^= state >> 17;
+            state ^= state << 5;
+            uv[k] = (state >> 8) / double(1 << 24);
+        }
+        checksum += IShader::sample2D(texture, uv)[1];
+    }
+    return nsamples / elapsed_ms(start) / 1000.;
+}
+
+static double coherent_msps(const Texture &texture, const int npasses, std::uint32_t &checksum)
+{
+    const auto start = bench_clock::now();
+    for (int pass = 0; pass < npasses; pass++)
+        for (int y = 0; y < texture.height(); y++)
+            for (int x = 0; x < texture.width(); x++)
+                checksum += IShader::sample2D(texture, {(x + .5) / texture.width(), (y + .5) / texture.height()})[1];
+    return static_cast<double>(npasses) * texture.width() * texture.height() / elapsed_ms(start) / 1000.;
+}
+
+static void write_json(std::ostream &out, const int reps, const std::vector<TextureResult> &results,
+                       const double raw_frame_ms, const double frame_ms, const double frame_mismatch)
+{
+    out << "{\n  \"model\": \"diablo3_pose\",\n  \"repetitions\": " << reps << ",\n  \"textures\": [\n";
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        const TextureResult &r = results[i];
+        out << "    {\"map\": \"" << r.map << "\", \"format\": \"" << texture_format_name(r.format)
+            << "\", \"width\": " << r.width << ", \"height\": " << r.height
+            << ", \"raw_bytes\": " << r.raw_bytes << ", \"bytes\": " << r.bytes
+            << ", \"encode_ms\": " << r.encode_ms
+            << ", \"psnr_db\": " << (std::isinf(r.psnr) ? 999. : r.psnr)
+            << ", \"raw_random_msps\": " << r.raw_random_msps << ", \"random_msps\": " << r.random_msps
+            << ", \"raw_coherent_msps\": " << r.raw_coherent_msps << ", \"coherent_msps\": " << r.coherent_msps
+            << "}" << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    out << "  ],\n  \"blinn_phong\": {\"raw_ms\": " << raw_frame_ms << ", \"compressed_ms\": " << frame_ms
+        << ", \"mismatch\": " << frame_mismatch << "}\n}\n";
+}
+
+int main(int argc, char **argv)
+{
+    const BenchOptions options = parse_options(argc, argv, 5);
+    const int reps = options.reps;
+
+    const std::pair<const char *, TextureFormat> maps[] = {
+        {"diffuse", TextureFormat::BC1}, {"spec", TextureFormat::BC4}, {"nm_tangent", TextureFormat::BC5}
+    };
+    std::vector<TextureResult> results;
+    std::uint32_t checksum = 0;
+    for (const auto &[name, format]: maps)
+    {
+        const std::string filename = std::string("../Obj/diablo3_pose_") + name + ".tga";
+        TGAImage image;
+        if (!image.read_tga_file(filename))
+        {
+            std::cerr << "can't load " << filename << std::endl;
+            return 1;
+        }
+        const Texture raw(image);
+        TextureResult r = {name, format, image.width(), image.height(), raw.bytes()};
+        Texture compressed;
+        for (int rep = 0; rep < reps; rep++)
+        {
+            const auto start = bench_clock::now();
+            compressed = Texture(image, format);
+            const double ms = elapsed_ms(start);
+            if (!rep || ms < r.encode_ms) r.encode_ms = ms;
+        }
+        r.bytes = compressed.bytes();
+        r.psnr = psnr(image, compressed, format);
+        constexpr int nsamples = 1 << 22;
+        for (int rep = 0; rep < reps; rep++) // best of reps, raw and compressed interleaved
+        {
+            r.raw_random_msps = std::max(r.raw_random_msps, random_msps(raw, nsamples, checksum));
+            r.random_msps = std::max(r.random_msps, random_msps(compressed, nsamples, checksum));
+            r.raw_coherent_msps = std::max(r.raw_coherent_msps, coherent_msps(raw, 2, checksum));
+            r.coherent_msps = std::max(r.coherent_msps, coherent_msps(compressed, 2, checksum));
+        }
+        std::cerr << name << " " << texture_format_name(format) << ": " << r.raw_bytes << " => " << r.bytes
+                  << " bytes, PSNR " << r.psnr << " dB, random " << r.raw_random_msps << " => " << r.random_msps
+                  << " Msamples/s, coherent " << r.raw_coherent_msps << " => " << r.coherent_msps << " Msamples/s"
+                  << std::endl;
+        results.push_back(r);
+    }
+
+    // the same frame with both models; the compressed one goes through the .blk cache after the first run
+    const Model model("../Obj/diablo3_pose.obj");
+    const Model compressed_model("../Obj/diablo3_pose.obj", 1, true);
+    constexpr int size = 800;
+    constexpr vec3 eye{-1, 0, 2};
+    constexpr TGAColor background = {177, 195, 209, 255};
+    lookat(eye, {0, 0, 0}, {0, 1, 0});
+    init_perspective(norm(eye));
+    init_viewport(size / 16, size / 16, size * 7 / 8, size * 7 / 8);
+    const BlinnPhongShader shader(vec3{1, 1, 1}, vec3{0, 0, 1}, model);
+    const BlinnPhongShader compressed_shader(vec3{1, 1, 1}, vec3{0, 0, 1}, compressed_model);
+    RenderTarget reference(size, size, TGAImage::RGB), target(size, size, TGAImage::RGB);
+    double raw_frame_ms = 0, frame_ms = 0;
+    for (int rep = 0; rep < reps; rep++)
+    {
+        reference.clear(background);
+        auto start = bench_clock::now();
+        draw(model.nfaces(), shader, reference.color, reference.depth);
+        const double raw_ms = elapsed_ms(start);
+        target.clear(background);
+        start = bench_clock::now();
+        draw(compressed_model.nfaces(), compressed_shader, target.color, target.depth);
+        const double ms = elapsed_ms(start);
+        if (!rep || raw_ms < raw_frame_ms) raw_frame_ms = raw_ms;
+        if (!rep || ms < frame_ms) frame_ms = ms;
+    }
+    const double frame_mismatch = mismatch(reference, target, 8);
+    std::cerr << "blinn_phong frame: " << raw_frame_ms << " ms raw, " << frame_ms << " ms compressed, "
+              << 100 * frame_mismatch << "% pixels differ by more than 8 levels, textures " << model.texture_bytes()
+              << " => " << compressed_model.texture_bytes() << " bytes (checksum " << checksum << ")" << std::endl;
+
+    write_results(options, [&](std::ostream &out)
+    {
+        write_json(out, reps, results, raw_frame_ms, frame_ms, frame_mismatch);
+    });
+    return 0;
+}
@@ -0,0 +1,210 @@
+//
+// Rendering benchmark: fixed scenes x resolutions x shaders x pipeline modes, results as JSON on stdout
+// usage: bench_renderer [--reps N] [--out results.json], see bench_common.h
+//
+
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "bench_common.h"
+#include "frame_arena.h"
+#include "gl_mine.h"
+#include "Model.h"
+#include "npr.h"
+#include "shaders.h"
+
+struct BenchScene
+{
+    const char *name;
+    const char *path;
+    vec3 eye, center;
+    int grid = 1; // grid x grid copies of the mesh (merged into one model, or instances of it in instanced mode)
+};
+
+struct BenchResult
+{
+    std::string scene, shader, mode;
+    int resolution = 0;
+    double load_ms = 0;
+    DrawStats stats; // best repetition
+    double post_ms = 0, total_ms = 0;
+    long allocations = -1; // heap allocations during the frame, counted by -DGL_PROFILE=ON builds only
+    long peak_rss_kb = 0; // of the process, once the frame is done
+};
+
+// renders one frame, the stats of the draw (or of the immediate mode loop) are accumulated in stats;
+// model holds all the copies of mesh, the instanced mode draws mesh once per instance instead
+static void render(const Model &model, const Model &mesh, const std::vector<Instance> &instances,
+                   const std::string &shader_name, const std::string &mode, RenderTarget &target,
+                   std::vector<RenderTarget> &contexts, DrawStats &stats)
+{
+    constexpr vec3 light_dir{1, 1, 1};
+    constexpr vec4 toon_color = {22 * 4, 56 * 4, 147 * 4, 255};
+    std::unique_ptr<IShader> shader;
+    if (mode == "instanced")
+    {
+        if (shader_name == "toon") shader = std::make_unique<ToonShader>(toon_color, light_dir, mesh);
+        else shader = std::make_unique<BlinnPhongShader>(light_dir, vec3{0, 0, 1}, mesh);
+        draw_instanced(mesh.nfaces(), *shader, instances, target.color, target.depth, &stats);
+        return;
+    }
+    if (shader_name == "toon") shader = std::make_unique<ToonShader>(toon_color, light_dir, model);
+    else shader = std::make_unique<BlinnPhongShader>(light_dir, vec3{0, 0, 1}, model);
+
+    if (mode == "draw")
+    {
+        draw(model.nfaces(), *shader, target.color, target.depth, &stats);
+        return;
+    }
+    if (mode == "sort_last")
+    {
+        draw_sort_last(model.nfaces(), *shader, target.color, target.depth, contexts, &stats);
+        return;
+    }
+    // immediate mode: one triangle at a time on the calling thread, as the lessons do
+    auto start = bench_clock::now();
+    std::vector<Triangle> tris(model.nfaces());
+    for (int f = 0; f < model.nfaces(); f++)
+        for (int v: {0, 1, 2})
+            tris[f].clip[v] = shader->vertex(f, v, tris[f].varying[v]);
+    stats.vertex_ms += elapsed_ms(start);
+    start = bench_clock::now();
+    for (const Triangle &tri: tris)
+        rasterize(tri, *shader, target.color, target.depth, &stats);
+    stats.raster_ms += elapsed_ms(start);
+}
+
+static void write_json(std::ostream &out, const std::vector<BenchResult> &results, const int reps)
+{
+    int threads = 1;
+#ifdef _OPENMP
+    threads = omp_get_max_threads();
+#endif
+#ifdef GL_FLOAT_PIPELINE
+    const char *precision = "float";
+#else
+    const char *precision = "double";
+#endif
+    out << "{\n  \"precision\": \"" << precision << "\",\n  \"threads\": " << threads
+        << ",\n  \"hardware_concurrency\": " << std::thread::hardware_concurrency()
+        << ",\n  \"repetitions\": " << reps << ",\n  \"results\": [\n";
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        const BenchResult &r = results[i];
+        const double seconds = r.total_ms / 1000;
+        out << "    {\"scene\": \"" << r.scene << "\", \"resolution\": " << r.resolution
+            << ", \"shader\": \"" << r.shader << "\", \"mode\": \"" << r.mode << "\""
+            << ", \"load_ms\": " << r.load_ms
+            << ", \"vertex_ms\": " << r.stats.vertex_ms
+            << ", \"raster_ms\": " << r.stats.raster_ms
+            << ", \"post_ms\": " << r.post_ms
+            << ", \"total_ms\": " << r.total_ms
+            << ", \"triangles\": " << r.stats.triangles
+            << ", \"visible_triangles\": " << r.stats.visible
+            << ", \"fragments\": " << r.stats.fragments
+            << ", \"triangles_per_s\": " << r.stats.triangles / seconds
+            << ", \"fragments_per_s\": " << r.stats.fragments / seconds
+            << ", \"allocations\": " << (r.allocations < 0 ? "null" : std::to_string(r.allocations))
+            << ", \"peak_rss_kb\": " << r.peak_rss_kb
+            << ", \"fps\": " << 1 / seconds << "}" << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    out << "  ]\n}\n";
+}
+
+int main(int argc, char **argv)
+{
+    const BenchOptions options = parse_options(argc, argv, 3);
+
+    const BenchScene scenes[] = {
+        {"african_head", "../Obj/african_head.obj", {-1, 0, 2}, {0, 0, 0}},
+        {"diablo3_pose", "../Obj/diablo3_pose.obj", {-1, 0, 2}, {0, 0, 0}},
+        {"floor", "../Obj/floor.obj", {1, 1, 3}, {0, -1, 0}},
+        {"diablo3_grid", "../Obj/diablo3_pose.obj", {-1, 1, 3}, {0, 0, 0}, 8}, // overlapping copies: high depth complexity
+    };
+    const int resolutions[] = {512, 1024};
+    const char *shaders[] = {"toon", "blinn_phong"};
+    const char *modes[] = {"immediate", "draw", "sort_last", "instanced"};
+    int ncontexts = static_cast<int>(std::thread::hardware_concurrency());
+#ifdef _OPENMP
+    ncontexts = omp_get_max_threads();
+#endif
+    std::vector<RenderTarget> contexts(std::max(2, ncontexts), RenderTarget(1, 1, TGAImage::RGBA));
+    constexpr TGAColor background = {177, 195, 209, 255};
+
+    std::vector<BenchResult> results;
+    for (const BenchScene &scene: scenes)
+    {
+        auto start = bench_clock::now();
+        const Model mesh(scene.path);
+        std::vector<vec3> offsets;
+        std::vector<Instance> instances;
+        for (int i = 0; i < scene.grid; i++)
+        {
+            for (int j = 0; j < scene.grid; j++)
+            {
+                const vec3 o = {.25 * (i - (scene.grid - 1) / 2.), 0, .25 * (j - (scene.grid - 1) / 2.)};
+                offsets.push_back(o);
+                instances.push_back({mat<4, 4>{{{1, 0, 0, o.x}, {0, 1, 0, o.y}, {0, 0, 1, o.z}, {0, 0, 0, 1}}}});
+            }
+        }
+        const std::unique_ptr<Model> merged = scene.grid > 1 ? std::make_unique<Model>(mesh, offsets) : nullptr;
+        const Model &model = merged ? *merged : mesh;
+        const double load_ms = elapsed_ms(start);
+        if (!model.nfaces())
+        {
+            std::cerr << "skipping " << scene.name << ": can't load " << scene.path << std::endl;
+            continue;
+        }
+
+        for (const int resolution: resolutions)
+        {
+            RenderTarget target(resolution, resolution, TGAImage::RGB);
+            lookat(scene.eye, scene.center, {0, 1, 0});
+            init_perspective(norm(scene.eye - scene.center));
+            init_viewport(resolution / 16, resolution / 16, resolution * 7 / 8, resolution * 7 / 8);
+            for (const char *shader: shaders)
+            {
+                for (const char *mode: modes)
+                {
+                    BenchResult best;
+                    for (int rep = 0; rep < options.reps; rep++)
+                    {
+                        BenchResult r;
+                        r.scene = scene.name;
+                        r.shader = shader;
+                        r.mode = mode;
+                        r.resolution = resolution;
+                        r.load_ms = load_ms;
+                        target.clear(background);
+                        const long allocations = heap_allocations();
+                        start = bench_clock::now();
+                        render(model, mesh, instances, shader, mode, target, contexts, r.stats);
+                        const auto post_start = bench_clock::now();
+                        outline(target.color, target.depth);
+                        r.post_ms = elapsed_ms(post_start);
+                        r.total_ms = elapsed_ms(start);
+                        frame_arena().reset();
+                        if (allocations >= 0) r.allocations = heap_allocations() - allocations;
+                        r.peak_rss_kb = peak_rss_kb();
+                        if (!rep || r.total_ms < best.total_ms) best = r;
+                    }
+                    std::cerr << scene.name << " " << resolution << " " << shader << " " << mode << ": "
+                              << best.total_ms << " ms";
+                    if (best.allocations >= 0) std::cerr << ", " << best.allocations << " allocations";
+                    std::cerr << std::endl;
+                    results.push_back(best);
+                }
+            }
+        }
+    }
+
+    write_results(options, [&](std::ostream &out) { write_json(out, results, options.reps); });
+    return 0;
+}
@@ -0,0 +1,124 @@
+//
+// Created by 25190 on 2026/10/18.
+//
+
+#include "frame_arena.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#ifdef _WIN32
+#define NOMINMAX // std::max below
+#define WIN32_LEAN_AND_MEAN
+#define PSAPI_VERSION 2 // GetProcessMemoryInfo from kernel32, no psapi.lib
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+FrameArena::FrameArena(const size_t capacity) {
+    if (capacity) {
+        blocks.push_back({std::make_unique<std::byte[]>(capacity), capacity});
+        nblocks++;
+    }
+}
+
+void *FrameArena::allocate_bytes(const size_t size, const size_t alignment) {
+    for (; block < blocks.size(); block++, offset = 0) { // the current block, or the next one large enough
+        const auto base = reinterpret_cast<std::uintptr_t>(blocks[block].data.get());
+        const size_t aligned = (base + offset + alignment - 1) / alignment * alignment - base;
+        if (aligned + size > blocks[block].size) continue;
+        offset = aligned + size;
+        peak_bytes = std::max(peak_bytes, mark_bytes());
+        return blocks[block].data.get() + aligned;
+    }
+    // out of space: a new block at the end, at least twice as large as the previous one
+    const size_t capacity = std::max({size + alignment, blocks.empty() ? 0 : 2 * blocks.back().size, size_t(1) << 16});
+    blocks.push_back({std::make_unique<std::byte[]>(capacity), capacity});
+    nblocks++;
+    block = blocks.size() - 1;
+    offset = 0;
+    return allocate_bytes(size, alignment);
+}
+
+size_t FrameArena::mark_bytes() const {
+    size_t bytes = offset;
+    for (size_t i = 0; i < block && i < blocks.size(); i++) bytes += blocks[i].size;
+    return bytes;
+}
+
+FrameArena::Mark FrameArena::mark() const {
+    return {block, offset};
+}
+
+void FrameArena::rewind(const Mark &mark) {
+    block = mark.block;
+    offset = mark.offset;
+}
+
+void FrameArena::reset() {
+    block = offset = 0;
+    if (blocks.size() < 2) return;
+    const size_t total = capacity();
+    blocks.clear();
+    blocks.push_back({std::make_unique<std::byte[]>(total), total});
+    nblocks++;
+}
+
+size_t FrameArena::capacity() const {
+    size_t bytes = 0;
+    for (const Block &b: blocks) bytes += b.size;
+    return bytes;
+}
+
+FrameArena &frame_arena() {
+    thread_local FrameArena arena;
+    return arena;
+}
+
+#ifdef GL_COUNT_ALLOCATIONS
+// operator new is replaced to count the allocations, the memory itself still comes from malloc; only in the builds
+// that report allocations (benchmarks, GL_PROFILE), the others keep the allocator untouched
+static std::atomic<long> nallocations{0};
+
+void *operator new(const std::size_t size) {
+    nallocations.fetch_add(1, std::memory_order_relaxed);
+    if (void *p = std::malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void *p, std::size_t) noexcept {
+    std::free(p);
+}
+
+long heap_allocations() {
+    return nallocations.load(std::memory_order_relaxed);
+}
+#else
+long heap_allocations() {
+    return -1;
+}
+#endif
+
+long peak_rss_kb() {
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) return 0;
+    return static_cast<long>(counters.PeakWorkingSetSize / 1024);
+#else
+    rusage usage = {};
+    getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+    return usage.ru_maxrss / 1024; // bytes on macOS
+#else
+    return usage.ru_maxrss;
+#endif
+#endif
+}
@@ -0,0 +1,86 @@
+//
+// Created by 25190 on 2026/10/18.
+//
+
+#ifndef FRAME_ARENA_H
+#define FRAME_ARENA_H
+
+#include <cstddef>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+// linear allocator for the transient data of a frame (triangles, bins, scratch buffers): allocating is a pointer
+// bump, nothing is freed individually, everything goes away with reset() between frames or with the Scope it was
+// allocated in; once warmed up, a frame no longer touches the heap
+class FrameArena {
+    struct Block {
+        std::unique_ptr<std::byte[]> data;
+        size_t size;
+    };
+
+    std::vector<Block> blocks = {};
+    size_t block = 0, offset = 0; // allocation cursor
+    size_t peak_bytes = 0; // high-water mark since construction
+    long nblocks = 0; // heap allocations made by the arena
+
+    void *allocate_bytes(const size_t size, const size_t alignment);
+
+    size_t mark_bytes() const; // bytes below the cursor, skipped block ends included
+
+public:
+    struct Mark {
+        size_t block, offset;
+    };
+
+    // rewinds the arena on destruction, for the scratch data of a single call
+    class Scope {
+        FrameArena &arena;
+        const Mark mark;
+
+    public:
+        explicit Scope(FrameArena &arena) : arena(arena), mark(arena.mark()) {}
+
+        ~Scope() { arena.rewind(mark); }
+
+        Scope(const Scope &) = delete;
+
+        Scope &operator=(const Scope &) = delete;
+    };
+
+    explicit FrameArena(const size_t capacity = 0); // the first block is allocated on first use
+
+    FrameArena(const FrameArena &) = delete;
+
+    FrameArena &operator=(const FrameArena &) = delete;
+
+    // n value-initialized Ts, the destructors are never run
+    template<class T>
+    T *allocate(const size_t n) {
+        static_assert(std::is_trivially_destructible_v<T>, "the arena never runs destructors");
+        T *p = static_cast<T *>(allocate_bytes(n * sizeof(T), alignof(T)));
+        std::uninitialized_value_construct_n(p, n);
+        return p;
+    }
+
+    Mark mark() const;
+
+    void rewind(const Mark &mark); // releases everything allocated after mark
+
+    void reset(); // end of frame: releases everything, merges the blocks so that the next frame fits in one
+
+    size_t capacity() const;
+
+    size_t peak() const { return peak_bytes; }
+
+    long nallocations() const { return nblocks; }
+};
+
+FrameArena &frame_arena(); // the calling thread's arena, like the "OpenGL" state each thread has its own
+
+// process-wide memory accounting, for the per-frame reports
+// number of operator new calls since startup, all threads; -1 unless built with GL_COUNT_ALLOCATIONS
+long heap_allocations();
+long peak_rss_kb(); // peak resident set size of the process
+
+#endif //FRAME_ARENA_H
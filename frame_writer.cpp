@@ -0,0 +1,61 @@
+//
+// Created by 25190 on 2026/10/18.
+//
+
+#include "frame_writer.h"
+
+FrameWriter::FrameWriter(RenderTargetPool &pool) : pool(pool), worker(&FrameWriter::run, this)
+{
+}
+
+FrameWriter::~FrameWriter()
+{
+    finish();
+}
+
+void FrameWriter::submit(RenderTarget &target, const std::string &filename)
+{
+    {
+        std::lock_guard lock(mutex);
+        queue.push_back({&target, filename});
+    }
+    pending.notify_one();
+}
+
+void FrameWriter::finish()
+{
+    {
+        std::lock_guard lock(mutex);
+        done = true;
+    }
+    pending.notify_one();
+    if (worker.joinable()) worker.join();
+}
+
+int FrameWriter::nfailures()
+{
+    std::lock_guard lock(mutex);
+    return failures;
+}
+
+void FrameWriter::run()
+{
+    while (true)
+    {
+        Job job;
+        {
+            std::unique_lock lock(mutex);
+            pending.wait(lock, [this] { return done || !queue.empty(); });
+            if (queue.empty()) return; // done and drained
+            job = queue.front();
+            queue.pop_front();
+        }
+        const bool ok = job.target->color.write_tga_file(job.filename);
+        pool.release(*job.target);
+        if (!ok)
+        {
+            std::lock_guard lock(mutex);
+            failures++;
+        }
+    }
+}
@@ -0,0 +1,45 @@
+//
+// Created by 25190 on 2026/10/18.
+//
+
+#ifndef FRAME_WRITER_H
+#define FRAME_WRITER_H
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include "gl_mine.h"
+
+// background thread RLE-encoding and writing finished frames while the next one is being rendered;
+// each target goes back to its pool once written
+class FrameWriter {
+    struct Job {
+        RenderTarget *target;
+        std::string filename;
+    };
+
+    RenderTargetPool &pool;
+    std::deque<Job> queue = {};
+    std::mutex mutex;
+    std::condition_variable pending;
+    bool done = false;
+    int failures = 0;
+    std::thread worker; // last member: started once everything else is initialized
+
+    void run();
+
+public:
+    explicit FrameWriter(RenderTargetPool &pool);
+
+    ~FrameWriter(); // writes the remaining frames before returning
+
+    void submit(RenderTarget &target, const std::string &filename);
+
+    void finish(); // blocks until every submitted frame is on disk
+
+    int nfailures(); // number of frames that could not be written
+};
+
+#endif //FRAME_WRITER_H
@@ -304,4 +304,302 @@ struct dt<1>
     }
 };
 
+template<typename M>
+auto det4x4(const M &a)
+{
+    return (a[0][0] * a[1][1] - a[0][1] * a[1][0]) * (a[2][2] * a[3][3] - a[2][3] * a[3][2])
+         - (a[0][0] * a[1][2] - a[0][2] * a[1][0]) * (a[2][1] * a[3][3] - a[2][3] * a[3][1])
+         + (a[0][0] * a[1][3] - a[0][3] * a[1][0]) * (a[2][1] * a[3][2] - a[2][2] * a[3][1])
+         + (a[0][1] * a[1][2] - a[0][2] * a[1][1]) * (a[2][0] * a[3][3] - a[2][3] * a[3][0])
+         - (a[0][1] * a[1][3] - a[0][3] * a[1][1]) * (a[2][0] * a[3][2] - a[2][2] * a[3][0])
+         + (a[0][2] * a[1][3] - a[0][3] * a[1][2]) * (a[2][0] * a[3][1] - a[2][1] * a[3][0]);
+}
+
+// closed-form 4x4 inverse (2x2 sub-determinant expansion), shared by mat<4,4> and mat4f
+template<typename M>
+M invert4x4(const M &a)
+{
+    const auto s0 = a[0][0] * a[1][1] - a[0][1] * a[1][0];
+    const auto s1 = a[0][0] * a[1][2] - a[0][2] * a[1][0];
+    const auto s2 = a[0][0] * a[1][3] - a[0][3] * a[1][0];
+    const auto s3 = a[0][1] * a[1][2] - a[0][2] * a[1][1];
+    const auto s4 = a[0][1] * a[1][3] - a[0][3] * a[1][1];
+    const auto s5 = a[0][2] * a[1][3] - a[0][3] * a[1][2];
+    const auto c5 = a[2][2] * a[3][3] - a[2][3] * a[3][2];
+    const auto c4 = a[2][1] * a[3][3] - a[2][3] * a[3][1];
+    const auto c3 = a[2][1] * a[3][2] - a[2][2] * a[3][1];
+    const auto c2 = a[2][0] * a[3][3] - a[2][3] * a[3][0];
+    const auto c1 = a[2][0] * a[3][2] - a[2][2] * a[3][0];
+    const auto c0 = a[2][0] * a[3][1] - a[2][1] * a[3][0];
+    const auto inv_det = 1 / (s0 * c5 - s1 * c4 + s2 * c3 + s3 * c2 - s4 * c1 + s5 * c0);
+
+    M ret;
+    ret[0][0] = (a[1][1] * c5 - a[1][2] * c4 + a[1][3] * c3) * inv_det;
+    ret[0][1] = (-a[0][1] * c5 + a[0][2] * c4 - a[0][3] * c3) * inv_det;
+    ret[0][2] = (a[3][1] * s5 - a[3][2] * s4 + a[3][3] * s3) * inv_det;
+    ret[0][3] = (-a[2][1] * s5 + a[2][2] * s4 - a[2][3] * s3) * inv_det;
+    ret[1][0] = (-a[1][0] * c5 + a[1][2] * c2 - a[1][3] * c1) * inv_det;
+    ret[1][1] = (a[0][0] * c5 - a[0][2] * c2 + a[0][3] * c1) * inv_det;
+    ret[1][2] = (-a[3][0] * s5 + a[3][2] * s2 - a[3][3] * s1) * inv_det;
+    ret[1][3] = (a[2][0] * s5 - a[2][2] * s2 + a[2][3] * s1) * inv_det;
+    ret[2][0] = (a[1][0] * c4 - a[1][1] * c2 + a[1][3] * c0) * inv_det;
+    ret[2][1] = (-a[0][0] * c4 + a[0][1] * c2 - a[0][3] * c0) * inv_det;
+    ret[2][2] = (a[3][0] * s4 - a[3][1] * s2 + a[3][3] * s0) * inv_det;
+    ret[2][3] = (-a[2][0] * s4 + a[2][1] * s2 - a[2][3] * s0) * inv_det;
+    ret[3][0] = (-a[1][0] * c3 + a[1][1] * c1 - a[1][2] * c0) * inv_det;
+    ret[3][1] = (a[0][0] * c3 - a[0][1] * c1 + a[0][2] * c0) * inv_det;
+    ret[3][2] = (-a[3][0] * s3 + a[3][1] * s1 - a[3][2] * s0) * inv_det;
+    ret[3][3] = (a[2][0] * s3 - a[2][1] * s1 + a[2][2] * s0) * inv_det;
+    return ret;
+}
+
+// the 4x4 case is hot (normal matrix), skip the recursive cofactor templates
+template<>
+inline double mat<4, 4>::det() const
+{
+    return det4x4(*this);
+}
+
+template<>
+inline mat<4, 4> mat<4, 4>::invert_transpose() const
+{
+    return invert4x4(*this).transpose();
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+// single precision 4-wide types: 16-byte aligned so that a vec4f maps onto one SSE / NEON register
+// ---------------------------------------------------------------------------------------------------------------------
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define GEOMETRY_SSE
+typedef __m128 simd4f;
+inline simd4f simd_load(const float *p) { return _mm_load_ps(p); }
+inline void simd_store(float *p, const simd4f v) { _mm_store_ps(p, v); }
+inline simd4f simd_loadu(const float *p) { return _mm_loadu_ps(p); } // no alignment requirement, for row kernels
+inline void simd_storeu(float *p, const simd4f v) { _mm_storeu_ps(p, v); }
+inline simd4f simd_set1(const float s) { return _mm_set1_ps(s); }
+inline simd4f simd_add(const simd4f a, const simd4f b) { return _mm_add_ps(a, b); }
+inline simd4f simd_sub(const simd4f a, const simd4f b) { return _mm_sub_ps(a, b); }
+inline simd4f simd_mul(const simd4f a, const simd4f b) { return _mm_mul_ps(a, b); }
+inline int simd_mask_gt(const simd4f a, const simd4f b) { return _mm_movemask_ps(_mm_cmpgt_ps(a, b)); } // bit i: a[i] > b[i]
+inline float simd_hsum(const simd4f v)
+{
+    const simd4f s = _mm_add_ps(v, _mm_movehl_ps(v, v));
+    return _mm_cvtss_f32(_mm_add_ss(s, _mm_shuffle_ps(s, s, 1)));
+}
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define GEOMETRY_NEON
+typedef float32x4_t simd4f;
+inline simd4f simd_load(const float *p) { return vld1q_f32(p); }
+inline void simd_store(float *p, const simd4f v) { vst1q_f32(p, v); }
+inline simd4f simd_loadu(const float *p) { return vld1q_f32(p); }
+inline void simd_storeu(float *p, const simd4f v) { vst1q_f32(p, v); }
+inline simd4f simd_set1(const float s) { return vdupq_n_f32(s); }
+inline simd4f simd_add(const simd4f a, const simd4f b) { return vaddq_f32(a, b); }
+inline simd4f simd_sub(const simd4f a, const simd4f b) { return vsubq_f32(a, b); }
+inline simd4f simd_mul(const simd4f a, const simd4f b) { return vmulq_f32(a, b); }
+inline int simd_mask_gt(const simd4f a, const simd4f b)
+{
+    constexpr uint32_t bits[4] = {1, 2, 4, 8};
+    return vaddvq_u32(vandq_u32(vcgtq_f32(a, b), vld1q_u32(bits)));
+}
+inline float simd_hsum(const simd4f v) { return vaddvq_f32(v); }
+#else
+struct simd4f { float v[4]; }; // portable fallback, the compiler is free to auto-vectorize it
+inline simd4f simd_load(const float *p) { return {{p[0], p[1], p[2], p[3]}}; }
+inline void simd_store(float *p, const simd4f v) { for (int i = 4; i--; p[i] = v.v[i]); }
+inline simd4f simd_loadu(const float *p) { return simd_load(p); }
+inline void simd_storeu(float *p, const simd4f v) { simd_store(p, v); }
+inline simd4f simd_set1(const float s) { return {{s, s, s, s}}; }
+inline simd4f simd_add(const simd4f a, const simd4f b) { return {{a.v[0] + b.v[0], a.v[1] + b.v[1], a.v[2] + b.v[2], a.v[3] + b.v[3]}}; }
+inline simd4f simd_sub(const simd4f a, const simd4f b) { return {{a.v[0] - b.v[0], a.v[1] - b.v[1], a.v[2] - b.v[2], a.v[3] - b.v[3]}}; }
+inline simd4f simd_mul(const simd4f a, const simd4f b) { return {{a.v[0] * b.v[0], a.v[1] * b.v[1], a.v[2] * b.v[2], a.v[3] * b.v[3]}}; }
+inline int simd_mask_gt(const simd4f a, const simd4f b) { return (a.v[0] > b.v[0]) | (a.v[1] > b.v[1]) << 1 | (a.v[2] > b.v[2]) << 2 | (a.v[3] > b.v[3]) << 3; }
+inline float simd_hsum(const simd4f v) { return (v.v[0] + v.v[1]) + (v.v[2] + v.v[3]); }
+#endif
+
+struct alignas(16) vec4f
+{
+    float x = 0, y = 0, z = 0, w = 0;
+
+    vec4f() = default;
+
+    constexpr vec4f(const double x, const double y, const double z, const double w) : x(x), y(y), z(z), w(w) {}
+
+    // implicit on purpose: double precision model data feeds the float pipeline without casts in the shaders
+    constexpr vec4f(const vec<4> &v) : x(v.x), y(v.y), z(v.z), w(v.w) {}
+
+    explicit vec4f(const simd4f v) { simd_store(&x, v); }
+
+    simd4f simd() const { return simd_load(&x); }
+
+    float &operator[](const int i)
+    {
+        assert(i>=0 && i<4);
+        return (&x)[i];
+    }
+
+    float operator[](const int i) const
+    {
+        assert(i>=0 && i<4);
+        return (&x)[i];
+    }
+
+    vec<2> xy() const { return {x, y}; }
+    vec<3> xyz() const { return {x, y, z}; }
+};
+
+inline float operator*(const vec4f &lhs, const vec4f &rhs)
+{
+    return simd_hsum(simd_mul(lhs.simd(), rhs.simd()));
+}
+
+inline vec4f operator+(const vec4f &lhs, const vec4f &rhs)
+{
+    return vec4f(simd_add(lhs.simd(), rhs.simd()));
+}
+
+inline vec4f operator-(const vec4f &lhs, const vec4f &rhs)
+{
+    return vec4f(simd_sub(lhs.simd(), rhs.simd()));
+}
+
+inline vec4f operator*(const vec4f &lhs, const float rhs)
+{
+    return vec4f(simd_mul(lhs.simd(), simd_set1(rhs)));
+}
+
+inline vec4f operator*(const float lhs, const vec4f &rhs)
+{
+    return rhs * lhs;
+}
+
+inline vec4f operator/(const vec4f &lhs, const float rhs)
+{
+    return lhs * (1.f / rhs);
+}
+
+inline std::ostream &operator<<(std::ostream &out, const vec4f &v)
+{
+    for (int i = 0; i < 4; i++) out << v[i] << " ";
+    return out;
+}
+
+inline float norm(const vec4f &v)
+{
+    return std::sqrt(v * v);
+}
+
+inline vec4f normalized(const vec4f &v)
+{
+    return v / norm(v);
+}
+
+struct alignas(16) mat4f
+{
+    vec4f rows[4] = {};
+
+    mat4f() = default;
+
+    mat4f(const vec4f &r0, const vec4f &r1, const vec4f &r2, const vec4f &r3) : rows{r0, r1, r2, r3} {}
+
+    mat4f(const mat<4, 4> &m) : rows{m[0], m[1], m[2], m[3]} {}
+
+    vec4f &operator[](const int idx)
+    {
+        assert(idx>=0 && idx<4);
+        return rows[idx];
+    }
+
+    const vec4f &operator[](const int idx) const
+    {
+        assert(idx>=0 && idx<4);
+        return rows[idx];
+    }
+
+    float det() const
+    {
+        return det4x4(*this);
+    }
+
+    mat4f invert_transpose() const
+    {
+        return invert().transpose();
+    }
+
+    mat4f invert() const
+    {
+        return invert4x4(*this);
+    }
+
+    mat4f transpose() const
+    {
+#ifdef GEOMETRY_SSE
+        simd4f r0 = rows[0].simd(), r1 = rows[1].simd(), r2 = rows[2].simd(), r3 = rows[3].simd();
+        _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+        return {vec4f(r0), vec4f(r1), vec4f(r2), vec4f(r3)};
+#else
+        mat4f ret;
+        for (int i = 4; i--;)
+            for (int j = 4; j--; ret[i][j] = rows[j][i]);
+        return ret;
+#endif
+    }
+};
+
+inline vec4f operator*(const mat4f &lhs, const vec4f &rhs)
+{
+#ifdef GEOMETRY_SSE
+    const simd4f v = rhs.simd();
+    simd4f p0 = simd_mul(lhs[0].simd(), v), p1 = simd_mul(lhs[1].simd(), v);
+    simd4f p2 = simd_mul(lhs[2].simd(), v), p3 = simd_mul(lhs[3].simd(), v);
+    _MM_TRANSPOSE4_PS(p0, p1, p2, p3); // four horizontal sums at once
+    return vec4f(simd_add(simd_add(p0, p1), simd_add(p2, p3)));
+#else
+    return {lhs[0] * rhs, lhs[1] * rhs, lhs[2] * rhs, lhs[3] * rhs};
+#endif
+}
+
+inline vec4f operator*(const vec4f &lhs, const mat4f &rhs)
+{
+    simd4f ret = simd_mul(simd_set1(lhs.x), rhs[0].simd());
+    ret = simd_add(ret, simd_mul(simd_set1(lhs.y), rhs[1].simd()));
+    ret = simd_add(ret, simd_mul(simd_set1(lhs.z), rhs[2].simd()));
+    ret = simd_add(ret, simd_mul(simd_set1(lhs.w), rhs[3].simd()));
+    return vec4f(ret);
+}
+
+inline mat4f operator*(const mat4f &lhs, const mat4f &rhs)
+{
+    return {lhs[0] * rhs, lhs[1] * rhs, lhs[2] * rhs, lhs[3] * rhs};
+}
+
+inline mat4f operator*(const mat4f &lhs, const float val)
+{
+    return {lhs[0] * val, lhs[1] * val, lhs[2] * val, lhs[3] * val};
+}
+
+inline mat4f operator/(const mat4f &lhs, const float val)
+{
+    return lhs * (1.f / val);
+}
+
+inline mat4f operator+(const mat4f &lhs, const mat4f &rhs)
+{
+    return {lhs[0] + rhs[0], lhs[1] + rhs[1], lhs[2] + rhs[2], lhs[3] + rhs[3]};
+}
+
+inline mat4f operator-(const mat4f &lhs, const mat4f &rhs)
+{
+    return {lhs[0] - rhs[0], lhs[1] - rhs[1], lhs[2] - rhs[2], lhs[3] - rhs[3]};
+}
+
+inline std::ostream &operator<<(std::ostream &out, const mat4f &m)
+{
+    for (int i = 0; i < 4; i++) out << m[i] << std::endl;
+    return out;
+}
+
 #endif //GEOMETRY_H
@@ -5,24 +5,28 @@
 #include "gl_mine.h"
 
 #include <algorithm>
+#include <chrono>
 #include <vector>
+#include "frame_arena.h"
 #include "geometry.h"
+#include "profiler.h"
 #include "tgaimage.h"
 
 struct TGAImage;
-mat<4, 4> ModelView, Viewport, Perspective;
+thread_local gl_mat4 ModelView, Viewport, Perspective; // "OpenGL" state, current per thread like a GL context
 std::vector<double> zbuffer; // depth buffer
+static thread_local const InstanceUniforms *current_instance = nullptr; // see IShader::instance()
 
 // 视口变换矩阵
 void init_viewport(const int x, const int y, const int w, const int h)
 {
-    Viewport = {{{w / 2., 0, 0, x + w / 2.}, {0, h / 2., 0, y + h / 2.}, {0, 0, 1, 0}, {0, 0, 0, 1}}};
+    Viewport = mat<4, 4>{{{w / 2., 0, 0, x + w / 2.}, {0, h / 2., 0, y + h / 2.}, {0, 0, 1, 0}, {0, 0, 0, 1}}};
 }
 
 // 透视投影矩阵 projection matrix (f是焦距, f越大, 视野越窄)
 void init_perspective(const double f)
 {
-    Perspective = {{{1, 0, 0, 0}, {0, 1, 0, 0}, {0, 0, 1, 0}, {0, 0, -1 / f, 1}}};
+    Perspective = mat<4, 4>{{{1, 0, 0, 0}, {0, 1, 0, 0}, {0, 0, 1, 0}, {0, 0, -1 / f, 1}}};
 }
 
 // 视图变换矩阵 ModelView matrix
@@ -40,37 +44,445 @@ void init_zbuffer(const int width, const int height)
     zbuffer = std::vector(width * height, -1000.); // 初始化zbuffer设置为负无穷（无限远远）
 }
 
-void rasterize(const Triangle &clip, const IShader &shader, TGAImage &framebuffer)
+RenderTarget::RenderTarget(const int width, const int height, const int bpp) : color(width, height, bpp),
+    depth(static_cast<size_t>(width) * height, -1000.)
 {
-    vec4 ndc[3] = {clip[0] / clip[0].w, clip[1] / clip[1].w, clip[2] / clip[2].w}; // normalized device coordinates
-    vec2 screen[3] = {(Viewport * ndc[0]).xy(), (Viewport * ndc[1]).xy(), (Viewport * ndc[2]).xy()};
+}
+
+void RenderTarget::clear(const TGAColor &background)
+{
+    color.fill(background);
+    std::fill(depth.begin(), depth.end(), -1000.);
+}
+
+RenderTargetPool::RenderTargetPool(const int width, const int height, const int bpp, const int capacity)
+{
+    for (int i = 0; i < capacity; i++)
+    {
+        targets.push_back(std::make_unique<RenderTarget>(width, height, bpp));
+        available.push_back(targets.back().get());
+    }
+}
+
+RenderTarget &RenderTargetPool::acquire()
+{
+    std::unique_lock lock(mutex);
+    released.wait(lock, [this] { return !available.empty(); });
+    RenderTarget *target = available.back();
+    available.pop_back();
+    return *target;
+}
+
+void RenderTargetPool::release(RenderTarget &target)
+{
+    {
+        std::lock_guard lock(mutex);
+        available.push_back(&target);
+    }
+    released.notify_one();
+}
+
+void RenderTargetCache::evict(const size_t needed)
+{
+    while (total_bytes + needed > budget)
+    {
+        auto lru = entries.end();
+        for (auto it = entries.begin(); it != entries.end(); ++it)
+            if (!it->in_use && (lru == entries.end() || it->last_used < lru->last_used)) lru = it;
+        if (lru == entries.end()) return; // everything is in use, the budget is exceeded until some get released
+        total_bytes -= lru->bytes;
+        entries.erase(lru);
+    }
+}
+
+RenderTarget &RenderTargetCache::acquire(const int width, const int height, const int bpp)
+{
+    std::lock_guard lock(mutex);
+    for (Entry &entry: entries)
+    {
+        if (entry.in_use || entry.width != width || entry.height != height || entry.bpp != bpp) continue;
+        entry.in_use = true;
+        return *entry.target;
+    }
+    const size_t bytes = static_cast<size_t>(width) * height * (bpp + sizeof(double)); // color + depth
+    evict(bytes);
+    entries.push_back({std::make_unique<RenderTarget>(width, height, bpp), width, height, bpp, bytes, true, 0});
+    total_bytes += bytes;
+    return *entries.back().target;
+}
+
+void RenderTargetCache::release(RenderTarget &target)
+{
+    std::lock_guard lock(mutex);
+    for (Entry &entry: entries)
+    {
+        if (entry.target.get() != &target) continue;
+        entry.in_use = false;
+        entry.last_used = ++tick;
+    }
+    evict(0);
+}
+
+int RenderTargetCache::size()
+{
+    std::lock_guard lock(mutex);
+    return static_cast<int>(entries.size());
+}
+
+size_t RenderTargetCache::bytes()
+{
+    std::lock_guard lock(mutex);
+    return total_bytes;
+}
+
+Uniforms current_uniforms()
+{
+    return {ModelView, Perspective, Viewport, ModelView.invert_transpose()};
+}
+
+const InstanceUniforms *IShader::instance()
+{
+    return current_instance;
+}
+
+// screen-space data of a triangle, computed once and shared by all of its pixels
+struct TriangleSetup
+{
+    mat<3, 3> ABC_it; // maps {x,y,1} to the screen-space barycentric coordinates
+    vec3 ndc_z; // depth of the vertices
+    vec3 inv_w; // 1/w of the vertices for the perspective correction
+    int xmin, xmax, ymin, ymax; // bounding box clipped by the screen
+};
+
+// returns false if the triangle is culled
+static bool setup_triangle(const Triangle &tri, const gl_mat4 &viewport, const int width, const int height,
+                           TriangleSetup &setup)
+{
+    PROFILE_COUNT(PROF_TRIANGLES, 1);
+    const gl_vec4 *clip = tri.clip;
+    gl_vec4 ndc[3] = {clip[0] / clip[0].w, clip[1] / clip[1].w, clip[2] / clip[2].w}; // normalized device coordinates
+    vec2 screen[3] = {(viewport * ndc[0]).xy(), (viewport * ndc[1]).xy(), (viewport * ndc[2]).xy()};
     // screen coordinates
 
     mat<3, 3> ABC = {{{screen[0].x, screen[0].y, 1.}, {screen[1].x, screen[1].y, 1.}, {screen[2].x, screen[2].y, 1.}}};
-    if (ABC.det() < 1) return; // backface culling + discarding triangles that cover less than a pixel
+    if (ABC.det() < 1) // backface culling + discarding triangles that cover less than a pixel
+    {
+        PROFILE_COUNT(PROF_CULLED_AREA, 1);
+        return false;
+    }
     // 三角形面积：1/2*det(ABC)
 
     auto [bbminx,bbmaxx] = std::minmax({screen[0].x, screen[1].x, screen[2].x}); // bounding box for the triangle
     auto [bbminy,bbmaxy] = std::minmax({screen[0].y, screen[1].y, screen[2].y});
-    // defined by its top left and bottom right corners
-#pragma omp parallel for
-    for (int x = std::max<int>(bbminx, 0); x <= std::min<int>(bbmaxx, framebuffer.width() - 1); x++)
+    // defined by its top left and bottom right corners, clipped by the screen
+    setup.xmin = std::max<int>(bbminx, 0);
+    setup.xmax = std::min<int>(bbmaxx, width - 1);
+    setup.ymin = std::max<int>(bbminy, 0);
+    setup.ymax = std::min<int>(bbmaxy, height - 1);
+    if (setup.xmin > setup.xmax || setup.ymin > setup.ymax)
+    {
+        PROFILE_COUNT(PROF_CULLED_SCREEN, 1);
+        return false;
+    }
+
+    setup.ABC_it = ABC.invert_transpose(); // once per triangle, not once per pixel
+    setup.ndc_z = {ndc[0].z, ndc[1].z, ndc[2].z};
+    // 透视校正插值: attributes are affine in clip space, 1/w is affine in screen space
+    setup.inv_w = {1 / clip[0].w, 1 / clip[1].w, 1 / clip[2].w};
+    return true;
+}
+
+// rasterizes the rows [ymin, ymax] of the triangle, pixels outside of them are left to other threads;
+// returns the number of fragment shader invocations
+static long rasterize_rows(const Triangle &tri, const TriangleSetup &setup, const IShader &shader,
+                           TGAImage &framebuffer, std::vector<double> &depth, const int ymin, const int ymax)
+{
+    const int nvaryings = shader.nvaryings();
+    const int nflat = nvaryings + shader.nflat();
+    current_instance = tri.instance;
+    long fragments = 0;
+    long tested = 0, covered = 0, zfail = 0, discarded = 0; // for the profiler, optimized away otherwise
+    for (int y = std::max(setup.ymin, ymin); y <= std::min(setup.ymax, ymax); y++)
     {
-        // clip the bounding box by the screen
-        for (int y = std::max<int>(bbminy, 0); y <= std::min<int>(bbmaxy, framebuffer.height() - 1); y++)
+        for (int x = setup.xmin; x <= setup.xmax; x++)
         {
-            vec3 bc = ABC.invert_transpose() * vec3{static_cast<double>(x), static_cast<double>(y), 1.}; // 求得重心坐标
+            tested++;
+            vec3 bc = setup.ABC_it * vec3{static_cast<double>(x), static_cast<double>(y), 1.}; // 求得重心坐标
             // barycentric coordinates of {x,y} w.r.t the triangle
             if (bc.x < 0 || bc.y < 0 || bc.z < 0) continue;
             // negative barycentric coordinate => the pixel is outside the triangle
+            covered++;
 
-            double z = bc * vec3{ndc[0].z, ndc[1].z, ndc[2].z}; // linear interpolation of the depth
-            if (z <= zbuffer[x + y * framebuffer.width()]) continue;
-            // discard fragments that are too deep w.r.t the z-buffer
-            auto [discard, color] = shader.fragment(bc);
-            if (discard) continue; // fragment shader can discard current fragment
-            zbuffer[x + y * framebuffer.width()] = z; // update the z-buffer
+            double z = bc * setup.ndc_z; // linear interpolation of the depth
+            if (z <= depth[x + y * framebuffer.width()])
+            {
+                zfail++;
+                continue; // discard fragments that are too deep w.r.t the z-buffer
+            }
+
+            vec3 bc_clip = {bc.x * setup.inv_w.x, bc.y * setup.inv_w.y, bc.z * setup.inv_w.z};
+            bc_clip = bc_clip / (bc_clip.x + bc_clip.y + bc_clip.z); // perspective-correct barycentric coordinates
+            Varyings varying; // per-pixel state lives on the stack of the rasterizing thread
+            for (int i = 0; i < nvaryings; i++)
+                varying[i] = tri.varying[0][i] * bc_clip.x + tri.varying[1][i] * bc_clip.y + tri.varying[2][i] * bc_clip.z;
+            for (int i = nvaryings; i < nflat; i++)
+                varying[i] = tri.varying[2][i];
+
+            auto [discard, color] = shader.fragment(varying);
+            fragments++;
+            if (discard)
+            {
+                discarded++;
+                continue; // fragment shader can discard current fragment
+            }
+            depth[x + y * framebuffer.width()] = z; // update the z-buffer
             framebuffer.set(x, y, color); // update the framebuffer
         }
     }
+    PROFILE_COUNT(PROF_PIXELS_TESTED, tested);
+    PROFILE_COUNT(PROF_PIXELS_COVERED, covered);
+    PROFILE_COUNT(PROF_PIXELS_ZFAIL, zfail);
+    PROFILE_COUNT(PROF_FRAGMENTS, fragments);
+    PROFILE_COUNT(PROF_DISCARDED, discarded);
+    return fragments;
+}
+
+void rasterize(const Triangle &tri, const IShader &shader, TGAImage &framebuffer)
+{
+    rasterize(tri, shader, framebuffer, zbuffer);
+}
+
+void rasterize(const Triangle &tri, const IShader &shader, TGAImage &framebuffer, std::vector<double> &depth,
+               DrawStats *stats)
+{
+    TriangleSetup setup;
+    const bool visible = setup_triangle(tri, shader.uniforms.Viewport, framebuffer.width(), framebuffer.height(), setup);
+    const long fragments = visible ? rasterize_rows(tri, setup, shader, framebuffer, depth, 0, framebuffer.height() - 1) : 0;
+    if (!stats) return;
+    stats->triangles++;
+    stats->visible += visible;
+    stats->fragments += fragments;
+}
+
+// draw() of nfaces primitives, assemble(i, tri) runs the vertex shader on the 3 vertices of the i-th one
+template<class Assemble>
+static void draw_primitives(const int nfaces, const Assemble &assemble, const IShader &shader, TGAImage &framebuffer,
+                            std::vector<double> &depth, DrawStats *stats)
+{
+    PROFILE_SCOPE("draw");
+    using clock = std::chrono::steady_clock;
+    constexpr int band_height = 16; // rows per band, a band is rasterized by a single thread
+    const int nbands = (framebuffer.height() + band_height - 1) / band_height;
+
+    // the transient data of the draw lives in the thread's frame arena and is released on return
+    FrameArena &arena = frame_arena();
+    const FrameArena::Scope scope(arena);
+
+    // vertex processing + triangle setup, one face per iteration
+    const auto vertex_start = clock::now();
+    Triangle *tris = arena.allocate<Triangle>(nfaces);
+    TriangleSetup *setups = arena.allocate<TriangleSetup>(nfaces);
+    char *visible = arena.allocate<char>(nfaces);
+    {
+        PROFILE_SCOPE("draw/vertex");
+#pragma omp parallel for schedule(static)
+        for (int i = 0; i < nfaces; i++)
+        {
+            assemble(i, tris[i]); // assemble the primitive
+            visible[i] = setup_triangle(tris[i], shader.uniforms.Viewport, framebuffer.width(), framebuffer.height(),
+                                        setups[i]);
+        }
+    }
+    const auto raster_start = clock::now();
+
+    // binning: each band keeps the triangles touching it in submission order => deterministic z-fighting;
+    // counting sort into a single array, bin b is bins[bin_start[b]] ... bins[bin_start[b+1]-1]
+    int *bin_start = arena.allocate<int>(nbands + 1);
+    int *bins = nullptr;
+    long nvisible = 0;
+    {
+        PROFILE_SCOPE("draw/binning");
+        for (int i = 0; i < nfaces; i++)
+        {
+            if (!visible[i]) continue;
+            nvisible++;
+            for (int b = setups[i].ymin / band_height; b <= setups[i].ymax / band_height; b++)
+                bin_start[b + 1]++;
+        }
+        for (int b = 0; b < nbands; b++)
+            bin_start[b + 1] += bin_start[b];
+        bins = arena.allocate<int>(bin_start[nbands]);
+        int *bin_end = arena.allocate<int>(nbands);
+        std::copy(bin_start, bin_start + nbands, bin_end);
+        for (int i = 0; i < nfaces; i++)
+        {
+            if (!visible[i]) continue;
+            for (int b = setups[i].ymin / band_height; b <= setups[i].ymax / band_height; b++)
+                bins[bin_end[b]++] = i;
+        }
+    }
+
+    // rasterization: the bands are disjoint, no two threads ever touch the same pixel
+    long fragments = 0;
+#pragma omp parallel for schedule(dynamic) reduction(+:fragments)
+    for (int b = 0; b < nbands; b++)
+    {
+        PROFILE_SCOPE("draw/raster_band");
+        for (int k = bin_start[b]; k < bin_start[b + 1]; k++)
+            fragments += rasterize_rows(tris[bins[k]], setups[bins[k]], shader, framebuffer, depth, b * band_height,
+                                        (b + 1) * band_height - 1);
+    }
+
+    if (!stats) return;
+    const auto raster_stop = clock::now();
+    stats->vertex_ms += std::chrono::duration<double, std::milli>(raster_start - vertex_start).count();
+    stats->raster_ms += std::chrono::duration<double, std::milli>(raster_stop - raster_start).count();
+    stats->triangles += nfaces;
+    stats->visible += nvisible;
+    stats->fragments += fragments;
+}
+
+// draw() restricted to the faces [first, last)
+static void draw_faces(const int first, const int last, const IShader &shader, TGAImage &framebuffer,
+                       std::vector<double> &depth, DrawStats *stats)
+{
+    const auto assemble = [&](const int i, Triangle &tri)
+    {
+        for (int v: {0, 1, 2})
+            tri.clip[v] = shader.vertex(first + i, v, tri.varying[v]);
+    };
+    draw_primitives(std::max(last - first, 0), assemble, shader, framebuffer, depth, stats);
+}
+
+void draw(const int nfaces, const IShader &shader, TGAImage &framebuffer)
+{
+    draw(nfaces, shader, framebuffer, zbuffer);
+}
+
+void draw(const int nfaces, const IShader &shader, TGAImage &framebuffer, std::vector<double> &depth, DrawStats *stats)
+{
+    draw_faces(0, nfaces, shader, framebuffer, depth, stats);
+}
+
+void draw_range(const int first, const int last, const IShader &shader, TGAImage &framebuffer,
+                std::vector<double> &depth, DrawStats *stats)
+{
+    draw_faces(first, last, shader, framebuffer, depth, stats);
+}
+
+double pixels_per_unit(const Uniforms &uniforms, const gl_mat4 &modelview, const vec3 center, const double radius)
+{
+    // scale of the model => eye transform, the longest of the three axes
+    const double scale = std::max({norm(modelview * gl_vec4{1, 0, 0, 0}), norm(modelview * gl_vec4{0, 1, 0, 0}),
+                                   norm(modelview * gl_vec4{0, 0, 1, 0})});
+    gl_vec4 nearest = modelview * gl_vec4{center.x, center.y, center.z, 1};
+    nearest.z += scale * radius; // the camera looks down -z
+    const double w = (uniforms.Perspective * nearest).w;
+    if (w <= 0) return 1e30; // the sphere contains the eye
+    // the perspective divides x and y by w, the viewport maps [-1,1] to its size
+    return scale * std::max(std::abs(uniforms.Viewport[0][0]), std::abs(uniforms.Viewport[1][1])) / w;
+}
+
+void draw_instanced(const int nfaces, const IShader &shader, const std::vector<Instance> &instances,
+                    TGAImage &framebuffer, std::vector<double> &depth, DrawStats *stats)
+{
+    draw_instanced_range(0, nfaces, shader, instances, framebuffer, depth, stats);
+}
+
+void draw_instanced_range(const int first_face, const int last_face, const IShader &shader,
+                          const std::vector<Instance> &instances, TGAImage &framebuffer, std::vector<double> &depth,
+                          DrawStats *stats)
+{
+    PROFILE_SCOPE("draw_instanced");
+    const int nfaces = last_face - first_face;
+    const int ninstances = static_cast<int>(instances.size());
+    if (nfaces <= 0 || !ninstances) return;
+    FrameArena &arena = frame_arena();
+    const FrameArena::Scope scope(arena);
+    // one matrix product and inversion per instance, not per vertex
+    InstanceUniforms *setups = arena.allocate<InstanceUniforms>(ninstances);
+#pragma omp parallel for schedule(static)
+    for (int i = 0; i < ninstances; i++)
+    {
+        const gl_mat4 ModelView = shader.uniforms.ModelView * instances[i].transform;
+        setups[i] = {ModelView, ModelView.invert_transpose(), instances[i].color};
+    }
+
+    // the primitives go through the pipeline in batches of whole instances, so that thousands of instances
+    // do not need thousands of meshes worth of transformed triangles at once
+    constexpr int batch_faces = 1 << 16;
+    const int batch_instances = std::max(1, batch_faces / nfaces);
+    for (int first = 0; first < ninstances; first += batch_instances)
+    {
+        const int count = std::min(batch_instances, ninstances - first);
+        const auto assemble = [&](const int i, Triangle &tri)
+        {
+            const InstanceUniforms &instance = setups[first + i / nfaces];
+            for (int v: {0, 1, 2})
+                tri.clip[v] = shader.vertex_instanced(instance, first_face + i % nfaces, v, tri.varying[v]);
+            tri.instance = &instance;
+        };
+        draw_primitives(count * nfaces, assemble, shader, framebuffer, depth, stats);
+    }
+}
+
+void draw_sort_last(const int nfaces, const IShader &shader, TGAImage &framebuffer, std::vector<double> &depth,
+                    std::vector<RenderTarget> &contexts, DrawStats *stats)
+{
+    PROFILE_SCOPE("draw_sort_last");
+    const int ncontexts = static_cast<int>(contexts.size());
+    if (!ncontexts) return draw(nfaces, shader, framebuffer, depth, stats);
+    const int width = framebuffer.width(), height = framebuffer.height();
+    for (RenderTarget &context: contexts)
+        if (context.color.width() != width || context.color.height() != height)
+            context = RenderTarget(width, height, TGAImage::RGBA);
+
+    // each context renders a contiguous chunk of the faces on its own, the color buffers are left dirty:
+    // only the pixels written in this draw have a depth above the cleared value
+    const FrameArena::Scope scope(frame_arena());
+    DrawStats *context_stats = frame_arena().allocate<DrawStats>(ncontexts);
+#pragma omp parallel for schedule(static, 1)
+    for (int c = 0; c < ncontexts; c++)
+    {
+        std::fill(contexts[c].depth.begin(), contexts[c].depth.end(), -1000.);
+        draw_faces(static_cast<int>(static_cast<long>(nfaces) * c / ncontexts),
+                   static_cast<int>(static_cast<long>(nfaces) * (c + 1) / ncontexts), shader,
+                   contexts[c].color, contexts[c].depth, &context_stats[c]);
+    }
+
+    // depth compositing: the nearest fragment wins, ties go to the earlier chunk as with a single context
+    const auto composite_start = std::chrono::steady_clock::now();
+    {
+        PROFILE_SCOPE("draw_sort_last/composite");
+#pragma omp parallel for schedule(static)
+        for (int y = 0; y < height; y++)
+        {
+            for (int x = 0; x < width; x++)
+            {
+                const int i = x + y * width;
+                int nearest = -1;
+                for (int c = 0; c < ncontexts; c++)
+                {
+                    if (contexts[c].depth[i] <= depth[i]) continue;
+                    depth[i] = contexts[c].depth[i];
+                    nearest = c;
+                }
+                if (nearest >= 0) framebuffer.set(x, y, contexts[nearest].color.get(x, y));
+            }
+        }
+    }
+
+    if (!stats) return;
+    double vertex_ms = 0, raster_ms = 0;
+    for (int c = 0; c < ncontexts; c++) // the contexts run side by side: wall times are the slowest one's
+    {
+        const DrawStats &s = context_stats[c];
+        vertex_ms = std::max(vertex_ms, s.vertex_ms);
+        raster_ms = std::max(raster_ms, s.raster_ms);
+        stats->triangles += s.triangles;
+        stats->visible += s.visible;
+        stats->fragments += s.fragments;
+    }
+    stats->vertex_ms += vertex_ms;
+    stats->raster_ms += raster_ms + std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - composite_start).count();
 }
@@ -5,9 +5,25 @@
 #ifndef GL_MINE_H
 #define GL_MINE_H
 
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <vector>
 #include "geometry.h"
+#include "texture.h"
 #include "tgaimage.h"
 
+// pipeline precision: build with GL_FLOAT_PIPELINE to run vertex/varying math on 16-byte SIMD floats
+#ifdef GL_FLOAT_PIPELINE
+typedef float gl_real;
+typedef vec4f gl_vec4;
+typedef mat4f gl_mat4;
+#else
+typedef double gl_real;
+typedef vec4 gl_vec4;
+typedef mat<4, 4> gl_mat4;
+#endif
+
 void lookat(const vec3 eye, const vec3 center, const vec3 up);
 
 void init_perspective(const double f);
@@ -16,15 +32,192 @@ void init_viewport(const int x, const int y, const int w, const int h);
 
 void init_zbuffer(const int width, const int height);
 
+constexpr int gl_MaxVaryings = 4; // number of vec4 slots a vertex shader can hand over to the fragment shader
+
+// compact block of varyings: written per vertex by the vertex shader, interpolated per pixel by the pipeline
+struct Varyings {
+    gl_vec4 data[gl_MaxVaryings];
+
+    gl_vec4 &operator[](const int i) {
+        assert(i >= 0 && i < gl_MaxVaryings);
+        return data[i];
+    }
+
+    const gl_vec4 &operator[](const int i) const {
+        assert(i >= 0 && i < gl_MaxVaryings);
+        return data[i];
+    }
+};
+
+// per-draw constants: a snapshot of the "OpenGL" state matrices, never written once the draw has started
+struct Uniforms {
+    gl_mat4 ModelView, Perspective, Viewport;
+    gl_mat4 NormalMatrix; // ModelView.invert_transpose(), transforms normals to view coordinates
+};
+
+Uniforms current_uniforms(); // snapshot of what lookat(), init_perspective() and init_viewport() have set on this thread
+
+// per-instance attributes of an instanced draw
+struct Instance {
+    gl_mat4 transform = mat<4, 4>{{{1, 0, 0, 0}, {0, 1, 0, 0}, {0, 0, 1, 0}, {0, 0, 0, 1}}}; // object => world
+    gl_vec4 color = vec4{1, 1, 1, 1}; // tint, up to the shader
+};
+
+// per-instance constants, derived once per instance by draw_instanced() and handed to the vertex shader
+struct InstanceUniforms {
+    gl_mat4 ModelView; // uniforms.ModelView * transform
+    gl_mat4 NormalMatrix; // ModelView.invert_transpose()
+    gl_vec4 color;
+};
+
+// a shader only holds immutable uniforms, per-triangle and per-pixel state is owned by the pipeline,
+// hence one shader instance can be shared by all the threads of a draw call
 struct IShader {
+    const Uniforms uniforms;
+
+    IShader() : uniforms(current_uniforms()) {}
+
+    virtual ~IShader() = default;
+
     static TGAColor sample2D(const TGAImage &img, const vec2 &uvf) {
         return img.get(uvf[0] * img.width(), uvf[1] * img.height());
     }
 
-    virtual std::pair<bool, TGAColor> fragment(const vec3 bar) const = 0; // abstract class
+    static TGAColor sample2D(const Texture &tex, const vec2 &uvf) { // block-compressed textures decode the texel here
+        return tex.get(uvf[0] * tex.width(), uvf[1] * tex.height());
+    }
+
+    virtual int nvaryings() const { return gl_MaxVaryings; } // varyings slots actually used, the rest is not interpolated
+
+    // "flat" varyings: the nflat() slots following the interpolated ones are copied from the provoking vertex
+    // (the last one, as in OpenGL), e.g. per-instance data
+    virtual int nflat() const { return 0; }
+
+    // returns the clip coordinates of the vertex and fills its varyings
+    virtual gl_vec4 vertex(const int face, const int vert, Varyings &varying) const = 0;
+
+    // same for draw_instanced(): the instance matrices stand for uniforms.ModelView and uniforms.NormalMatrix,
+    // every shader has to apply them (and the instance color, if it has a slot for it) itself
+    virtual gl_vec4 vertex_instanced(const InstanceUniforms &instance, const int face, const int vert,
+                                     Varyings &varying) const = 0;
+
+    // for the fragment shader: the instance of the triangle being rasterized, nullptr outside of draw_instanced();
+    // per-instance data read from here does not take a varyings slot
+    static const InstanceUniforms *instance();
+
+    // gets perspective-correct interpolated varyings
+    virtual std::pair<bool, TGAColor> fragment(const Varyings &varying) const = 0; // abstract class
+};
+
+// a triangle primitive is made of three ordered points and the varyings of each of them
+struct Triangle {
+    gl_vec4 clip[3]; // clip coordinates
+    Varyings varying[3];
+    const InstanceUniforms *instance = nullptr; // set by draw_instanced()
+};
+
+// per-draw statistics, accumulated across calls like a GL query object
+struct DrawStats {
+    double vertex_ms = 0; // vertex shading + triangle setup
+    double raster_ms = 0; // binning (draw calls only), rasterization and fragment shading
+    long triangles = 0; // submitted
+    long visible = 0; // survived culling
+    long fragments = 0; // fragment shader invocations
+};
+
+void rasterize(const Triangle &tri, const IShader &shader, TGAImage &framebuffer); // depth test against zbuffer
+
+void rasterize(const Triangle &tri, const IShader &shader, TGAImage &framebuffer, std::vector<double> &depth,
+               DrawStats *stats = nullptr);
+
+// runs the vertex shader on faces [0, nfaces) and rasterizes them in submission order;
+// both stages are spread over the OpenMP threads, the framebuffer is split in bands of rows
+void draw(const int nfaces, const IShader &shader, TGAImage &framebuffer); // depth test against zbuffer
+
+void draw(const int nfaces, const IShader &shader, TGAImage &framebuffer, std::vector<double> &depth,
+          DrawStats *stats = nullptr);
+
+// draw() restricted to the faces [first, last), e.g. one level of detail of a Model
+void draw_range(const int first, const int last, const IShader &shader, TGAImage &framebuffer,
+                std::vector<double> &depth, DrawStats *stats = nullptr);
+
+// size in pixels of one model unit at the nearest point of the bounding sphere (center, radius), the model being
+// transformed by modelview (uniforms.ModelView, or that of an instance) => picks a level of detail
+double pixels_per_unit(const Uniforms &uniforms, const gl_mat4 &modelview, const vec3 center, const double radius);
+
+// instancing: draws the faces [0, nfaces) once per instance with shared vertex data, as one batch of primitives
+// ordered by instance then face; the instances are set up and transformed on the OpenMP threads
+void draw_instanced(const int nfaces, const IShader &shader, const std::vector<Instance> &instances,
+                    TGAImage &framebuffer, std::vector<double> &depth, DrawStats *stats = nullptr);
+
+void draw_instanced_range(const int first, const int last, const IShader &shader,
+                          const std::vector<Instance> &instances, TGAImage &framebuffer, std::vector<double> &depth,
+                          DrawStats *stats = nullptr);
+
+struct RenderTarget;
+
+// sort-last: the faces are split in contexts.size() contiguous chunks, each one is rendered by its own thread into
+// its own color+depth context, then the contexts are depth-composited into framebuffer/depth in parallel;
+// the contexts are (re)allocated to the framebuffer size and can be reused across frames
+void draw_sort_last(const int nfaces, const IShader &shader, TGAImage &framebuffer, std::vector<double> &depth,
+                    std::vector<RenderTarget> &contexts, DrawStats *stats = nullptr);
+
+// color + depth attachments of a frame, recycled through a RenderTargetPool instead of being reallocated
+struct RenderTarget {
+    TGAImage color;
+    std::vector<double> depth;
+
+    RenderTarget(const int width, const int height, const int bpp);
+
+    void clear(const TGAColor &background); // color <- background, depth <- infinitely far
 };
 
-typedef vec4 Triangle[3]; // a triangle primitive is made of three ordered points
-void rasterize(const Triangle &clip, const IShader &shader, TGAImage &framebuffer);
+// fixed set of render targets shared between the render loop and the consumers of finished frames;
+// acquire() blocks while every target is in flight, which throttles the producer
+class RenderTargetPool {
+    std::vector<std::unique_ptr<RenderTarget>> targets = {};
+    std::vector<RenderTarget *> available = {};
+    std::mutex mutex;
+    std::condition_variable released;
+
+public:
+    RenderTargetPool(const int width, const int height, const int bpp, const int capacity = 2);
+
+    RenderTarget &acquire();
+
+    void release(RenderTarget &target);
+};
+
+// render targets recycled by size and format: acquire() hands out a released target with the same key, or allocates
+// a new one => jobs of varying sizes stop reallocating their framebuffers once every size has been seen;
+// the idle targets are kept within budget bytes, the least recently released ones are freed first
+class RenderTargetCache {
+    struct Entry {
+        std::unique_ptr<RenderTarget> target;
+        int width, height, bpp;
+        size_t bytes;
+        bool in_use;
+        long last_used; // release() order, for the LRU eviction
+    };
+
+    const size_t budget;
+    std::vector<Entry> entries = {};
+    size_t total_bytes = 0;
+    long tick = 0;
+    std::mutex mutex;
+
+    void evict(const size_t needed); // frees idle targets until needed more bytes fit in the budget, lock held
+
+public:
+    explicit RenderTargetCache(const size_t budget = size_t(512) << 20) : budget(budget) {}
+
+    RenderTarget &acquire(const int width, const int height, const int bpp); // not cleared
+
+    void release(RenderTarget &target);
+
+    int size(); // number of targets currently allocated
+
+    size_t bytes(); // memory they take, in use or idle
+};
 
 #endif //GL_MINE_H
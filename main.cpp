@@ -1,108 +1,220 @@
 #include <random>
 #include <algorithm>
+#include <chrono>
+#include <climits>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
 
 #include "gl_mine.h"
-#include "model.h"
+#include "Model.h"
+#include "npr.h"
+#include "frame_arena.h"
+#include "frame_writer.h"
+#include "profiler.h"
+#include "render_server.h"
+#include "shaders.h"
 
-extern mat<4, 4> Viewport, ModelView, Perspective; // "OpenGL" state matrices and
 extern std::vector<double> zbuffer; // the depth buffer
 
-struct ToonShader : IShader
+constexpr vec3 light_dir{1, 1, 1}; // light source
+constexpr vec3 center{0, 0, 0}; // camera direction
+constexpr vec3 up{0, 1, 0}; // camera up vector
+constexpr TGAColor background = {177, 195, 209, 255};
+constexpr double pi = 3.14159265358979323846; // M_PI is POSIX, not standard C++
+
+// one frame of the toon scene seen from eye, the framebuffer and depth must be cleared beforehand;
+// with contexts, the mesh is rendered sort-last by as many workers
+void render_frame(const Model &model, const vec3 eye, TGAImage &framebuffer, std::vector<double> &depth,
+                  std::vector<RenderTarget> *contexts = nullptr)
 {
-    vec4 color;
-    const Model &model;
-    vec4 l; // light direction in eye coordinates
-    vec4 varying_nrm[3]; // normal per vertex to be interpolated by the fragment shader
+    PROFILE_SCOPE("render_frame");
+    const int width = framebuffer.width();
+    const int height = framebuffer.height();
+    lookat(eye, center, up);
+    init_perspective(norm(eye - center));
+    init_viewport(width / 16, height / 16, width * 7 / 8, height * 7 / 8);
 
-    ToonShader(const vec4 color, const vec3 light, const Model &m) : color(color), model(m)
-    {
-        l = normalized((ModelView * vec4{light.x, light.y, light.z, 0.}));
-        // transform the light vector to view coordinates
-    }
+    constexpr vec4 colors[] = {{22 * 4, 56 * 4, 147 * 4, 255}, {123, 98, 88, 255}};
 
-    virtual vec4 vertex(const int face, const int vert)
+    ToonShader shader(colors[0], light_dir, model);
+    if (contexts)
+        draw_sort_last(model.nfaces(), shader, framebuffer, depth, *contexts);
+    else // iterate through the facets of the level of detail that fits the screen size, one shader for all the threads
     {
-        varying_nrm[vert] = ModelView.invert_transpose() * model.normal(face, vert);
-        vec4 gl_Position = ModelView * model.vert(face, vert);
-        return Perspective * gl_Position;
+        const int lod = model.select_lod(pixels_per_unit(shader.uniforms, shader.uniforms.ModelView, model.center(),
+                                                         model.radius()));
+        draw_range(model.lod_begin(lod), model.lod_end(lod), shader, framebuffer, depth);
     }
 
-    virtual std::pair<bool, TGAColor> fragment(const vec3 bar) const
-    {
-        vec4 n = normalized(varying_nrm[0] * bar[0] + varying_nrm[1] * bar[1] + varying_nrm[2] * bar[2]);
-        // per-vertex normal interpolation
+    outline(framebuffer, depth); // post-processing: edge detection => outlines
+}
 
-        double diffuse = std::max(0., n * l); // diffuse light intensity
+// turntable: the camera orbits around the model, frame N is written by a background thread while N+1 is rendered
+int render_sequence(const Model &model, const vec3 eye, const int nframes, const int width, const int height)
+{
+    RenderTargetPool pool(width, height, TGAImage::RGB); // double buffering: two frames in flight at most
+    FrameWriter writer(pool);
 
-        double intensity = .15 + diffuse; // a bit of ambient light + diffuse light
-        if (intensity > .66) intensity = 1;
-        else if (intensity > .33) intensity = .66;
-        else intensity = .33;
+    const double radius = std::hypot(eye.x - center.x, eye.z - center.z);
+    const double angle0 = std::atan2(eye.x - center.x, eye.z - center.z);
+    const auto start = std::chrono::steady_clock::now();
+    for (int frame = 0; frame < nframes; frame++)
+    {
+        const double angle = angle0 + 2 * pi * frame / nframes;
+        const vec3 frame_eye = {center.x + radius * std::sin(angle), eye.y, center.z + radius * std::cos(angle)};
+
+        const long allocations = heap_allocations();
+        RenderTarget &target = pool.acquire();
+        target.clear(background);
+        render_frame(model, frame_eye, target.color, target.depth);
+
+        char filename[32];
+        std::snprintf(filename, sizeof(filename), "frame_%04d.tga", frame);
+        writer.submit(target, filename);
+        frame_arena().reset();
+        // process-wide, the writer thread's allocations are counted too
+        std::cerr << "frame " << frame << ": ";
+        if (allocations >= 0) std::cerr << heap_allocations() - allocations << " heap allocations, ";
+        std::cerr << frame_arena().capacity() / 1024 << "KB arena, peak RSS " << peak_rss_kb() / 1024 << "MB"
+                  << std::endl;
+    }
+    writer.finish();
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cerr << nframes << " frames in " << seconds << "s, " << nframes / seconds << " fps sustained" << std::endl;
+    return writer.nfailures() ? 1 : 0;
+}
 
-        TGAColor gl_FragColor;
-        for (int channel: {0, 1, 2})
-            gl_FragColor[channel] = std::min<int>(255, color[channel] * intensity);
-        return {false, gl_FragColor}; // do not discard the pixel
+int render_single(const Model &model, const vec3 eye, const int width, const int height, const int ncontexts)
+{
+    // usual rendering pass
+    init_zbuffer(width, height);
+    TGAImage framebuffer(width, height, TGAImage::RGB, background);
+    if (!ncontexts)
+        render_frame(model, eye, framebuffer, zbuffer);
+    else // draw_sort_last() sizes the contexts to the framebuffer
+    {
+        std::vector<RenderTarget> contexts(ncontexts, RenderTarget(1, 1, TGAImage::RGBA));
+        render_frame(model, eye, framebuffer, zbuffer, &contexts);
     }
-};
 
+    return framebuffer.write_tga_file("framebuffer.tga") ? 0 : 1;
+}
 
-int main()
+// a crowd of n x n copies of the model, shrunk to fit the viewport, each one turned and tinted its own way
+int render_crowd(const Model &model, const vec3 eye, const int n, const int width, const int height)
 {
-    constexpr int width = 800; // output image size
-    constexpr int height = 800;
-    constexpr vec3 light_dir{1, 1, 1}; // light source
-    constexpr vec3 eye{-1, 0, 2}; // camera position
-    constexpr vec3 center{0, 0, 0}; // camera direction
-    constexpr vec3 up{0, 1, 0}; // camera up vector
-
-    // usual rendering pass
+    init_zbuffer(width, height);
+    TGAImage framebuffer(width, height, TGAImage::RGB, background);
     lookat(eye, center, up);
     init_perspective(norm(eye - center));
     init_viewport(width / 16, height / 16, width * 7 / 8, height * 7 / 8);
-    init_zbuffer(width, height);
-    TGAImage framebuffer(width, height, TGAImage::RGB, {177, 195, 209, 255});
 
-    constexpr vec4 colors[] = {{22 * 4, 56 * 4, 147 * 4, 255}, {123, 98, 88, 255}};
+    std::vector<Instance> instances(n * n);
+    std::mt19937 rng(n);
+    std::uniform_real_distribution<double> uniform(0, 1);
+    const double scale = 1. / n, spacing = 2. / n;
+    for (int i = 0; i < n; i++)
+    {
+        for (int j = 0; j < n; j++)
+        {
+            const double angle = 2 * pi * uniform(rng), c = std::cos(angle) * scale, s = std::sin(angle) * scale;
+            const double x = spacing * (i - (n - 1) / 2.), z = spacing * (j - (n - 1) / 2.);
+            instances[i + j * n].transform = mat<4, 4>{{{c, 0, s, x}, {0, scale, 0, 0}, {-s, 0, c, z}, {0, 0, 0, 1}}};
+            instances[i + j * n].color = vec4{.5 + uniform(rng), .5 + uniform(rng), .5 + uniform(rng), 1};
+        }
+    }
 
-    Model model("../Obj/diablo3_pose.obj");
-    ToonShader shader(colors[0], light_dir, model);
-    for (int f = 0; f < model.nfaces(); f++)
+    constexpr vec4 color = {22 * 3, 56 * 3, 147 * 3, 255};
+    ToonShader shader(color, light_dir, model);
+
+    // one instanced draw per level of detail, the far instances go through the coarse meshes
+    std::vector<std::vector<Instance>> lods(model.nlods());
+    for (const Instance &instance: instances)
     {
-        // iterate through all facets
-        Triangle clip = {
-            shader.vertex(f, 0), // assemble the primitive
-            shader.vertex(f, 1),
-            shader.vertex(f, 2)
-        };
-        rasterize(clip, shader, framebuffer); // rasterize the primitive
+        const double ppu = pixels_per_unit(shader.uniforms, shader.uniforms.ModelView * instance.transform,
+                                           model.center(), model.radius());
+        lods[model.select_lod(ppu)].push_back(instance);
     }
+    DrawStats stats;
+    for (int lod = 0; lod < model.nlods(); lod++)
+        draw_instanced_range(model.lod_begin(lod), model.lod_end(lod), shader, lods[lod], framebuffer, zbuffer, &stats);
+    outline(framebuffer, zbuffer);
+    for (int lod = 0; lod < model.nlods(); lod++)
+        std::cerr << "LOD " << lod << ": " << lods[lod].size() << " instances" << std::endl;
+    std::cerr << instances.size() << " instances, " << stats.triangles << " triangles: vertex " << stats.vertex_ms
+              << "ms, raster " << stats.raster_ms << "ms" << std::endl;
+
+    return framebuffer.write_tga_file("framebuffer.tga") ? 0 : 1;
+}
+
+// built with GL_PROFILE: the pipeline counters go to stderr and the timeline to trace.json, once the work is done
+void report_profile()
+{
+#ifdef GL_PROFILE
+    profile_summary(std::cerr);
+    if (!profile_write_trace("trace.json")) std::cerr << "can't write trace.json" << std::endl;
+#endif
+}
 
-    // post-processing: edge detection => outlines
-    constexpr double threshold = .15;
-    for (int y = 1; y < framebuffer.height() - 1; ++y)
+// a count argument: a positive int and nothing else
+bool parse_count(const char *arg, int &count)
+{
+    char *end;
+    const long value = std::strtol(arg, &end, 10);
+    if (end == arg || *end || value < 1 || value > INT_MAX) return false;
+    count = static_cast<int>(value);
+    return true;
+}
+
+int usage(const char *program)
+{
+    std::cerr << "usage: " << program << "\n"
+              << "       " << program << " --sequence N | --sort-last N | --crowd N\n"
+              << "       " << program << " --server [- | spool file | spool dir] [workers] [cached models]" << std::endl;
+    return 2;
+}
+
+// usage: tinyrenderer_self                => framebuffer.tga
+//        tinyrenderer_self --sequence N   => frame_0000.tga ... frame_{N-1}.tga
+//        tinyrenderer_self --sort-last N  => framebuffer.tga, mesh split across N worker contexts
+//        tinyrenderer_self --crowd N      => framebuffer.tga, N x N instances of the mesh
+//        tinyrenderer_self --server [- | spool file | spool dir] [workers] [cached models]
+//                                         => one image per job line, see RenderJob
+// built with GL_PROFILE, the pipeline counters go to stderr and the timeline to trace.json (server mode included)
+int main(int argc, char **argv)
+{
+    constexpr int width = 800; // output image size
+    constexpr int height = 800;
+    constexpr vec3 eye{-1, 0, 2}; // camera position
+
+    if (argc >= 2 && std::string(argv[1]) == "--server")
     {
-        for (int x = 1; x < framebuffer.width() - 1; ++x)
-        {
-            vec2 sum;
-            for (int j = -1; j <= 1; ++j)
-            {
-                for (int i = -1; i <= 1; ++i)
-                {
-                    // Sobel filter for edge detection
-                    constexpr int Gx[3][3] = {{-1, 0, 1}, {-2, 0, 2}, {-1, 0, 1}};
-                    constexpr int Gy[3][3] = {{-1, -2, -1}, {0, 0, 0}, {1, 2, 1}};
-                    sum = sum + vec2{
-                              Gx[j + 1][i + 1] * zbuffer[x + i + (y + j) * width],
-                              Gy[j + 1][i + 1] * zbuffer[x + i + (y + j) * width]
-                          };
-                }
-            }
-            if (norm(sum) > threshold)
-                framebuffer.set(x, y, TGAColor{0, 0, 0, 255});
-        }
+        int nworkers = static_cast<int>(std::thread::hardware_concurrency()), ncached = 8;
+        if (argc > 5 || (argc >= 4 && !parse_count(argv[3], nworkers)) || (argc >= 5 && !parse_count(argv[4], ncached)))
+            return usage(argv[0]);
+        RenderServer server(nworkers, ncached);
+        const int ret = server.run(argc >= 3 ? argv[2] : "-") ? 1 : 0;
+        report_profile();
+        return ret;
     }
 
-    framebuffer.write_tga_file("framebuffer.tga");
-    return 0;
+    // no argument, or a mode and its count; anything else is a mistake, not a request for the default frame
+    const std::string mode = argc == 3 ? argv[1] : "";
+    int count = 0;
+    if (argc != 1 && (argc != 3 || (mode != "--sequence" && mode != "--sort-last" && mode != "--crowd")
+                      || !parse_count(argv[2], count)))
+        return usage(argv[0]);
+    // the levels of detail only pay off for the crowd, a single model close up always draws the full mesh
+    Model model("../Obj/diablo3_pose.obj", mode == "--crowd" ? 6 : 1);
+
+    const int ret = mode == "--sequence"
+                        ? render_sequence(model, eye, count, width, height)
+                        : mode == "--crowd"
+                        ? render_crowd(model, {-1, 1, 3}, count, width, height)
+                        : render_single(model, eye, width, height, count); // count: sort-last contexts, 0 if none
+    report_profile();
+    return ret;
 }
@@ -0,0 +1,129 @@
+//
+// Created by 25190 on 2026/10/18.
+//
+
+#include "npr.h"
+
+#include <algorithm>
+#include <cstdint>
+#include "frame_arena.h"
+#include "geometry.h"
+#include "profiler.h"
+
+// one row of the squared Sobel gradient of a buffer of interleaved channels (channels floats per pixel), summed over
+// the first three of them into mag2[1, width-1); above, row and below are the rows y-1, y and y+1, s, t and g2 are
+// scratch rows of width * channels floats (g2 unused for a single channel)
+static void sobel_row(const float *above, const float *row, const float *below, float *s, float *t, float *g2,
+                      float *mag2, const int width, const int channels)
+{
+    // vertical pass, channel-wise: s = 1 2 1 smoothing for Gx, t = -1 0 1 derivative for Gy
+    const int n = width * channels;
+    int k = 0;
+    for (; k + 4 <= n; k += 4)
+    {
+        const simd4f a = simd_loadu(above + k), c = simd_loadu(row + k), b = simd_loadu(below + k);
+        simd_storeu(s + k, simd_add(simd_add(a, b), simd_add(c, c)));
+        simd_storeu(t + k, simd_sub(b, a));
+    }
+    for (; k < n; k++)
+    {
+        s[k] = above[k] + below[k] + 2 * row[k];
+        t[k] = below[k] - above[k];
+    }
+    // horizontal pass, the neighbours of a channel are one pixel away: Gx = -1 0 1 derivative of s, Gy = 1 2 1
+    // smoothing of t; a single channel goes straight to mag2, interleaved ones through g2
+    const int d = channels;
+    float *g = channels == 1 ? mag2 : g2;
+    for (k = d; k + 4 <= n - d; k += 4)
+    {
+        const simd4f gx = simd_sub(simd_loadu(s + k + d), simd_loadu(s + k - d));
+        const simd4f tc = simd_loadu(t + k);
+        const simd4f gy = simd_add(simd_add(simd_loadu(t + k - d), simd_loadu(t + k + d)), simd_add(tc, tc));
+        simd_storeu(g + k, simd_add(simd_mul(gx, gx), simd_mul(gy, gy)));
+    }
+    for (; k < n - d; k++)
+    {
+        const float gx = s[k + d] - s[k - d], gy = t[k - d] + t[k + d] + 2 * t[k];
+        g[k] = gx * gx + gy * gy;
+    }
+    if (channels == 1) return;
+    for (int x = 1; x < width - 1; x++) // bgr, the alpha of a bgra buffer is left out
+        mag2[x] = g2[x * channels] + g2[x * channels + 1] + g2[x * channels + 2];
+}
+
+// shared by both outline() flavors, normals == nullptr for depth edges only
+static void detect_edges(TGAImage &framebuffer, const std::vector<double> &depth, const TGAImage *normals,
+                         const double threshold, const double normal_threshold)
+{
+    PROFILE_SCOPE("outline");
+    const int width = framebuffer.width(), height = framebuffer.height();
+    if (width < 3 || height < 3 || depth.size() < static_cast<size_t>(width) * height) return;
+    if (normals && (normals->width() != width || normals->height() != height || normals->bytespp() < 3))
+        normals = nullptr;
+    const float depth_threshold2 = threshold * threshold;
+    const float normal_threshold2 = normal_threshold * normal_threshold * (255. / 2) * (255. / 2); // encoded units
+    const std::uint8_t *encoded = normals ? normals->buffer() : nullptr;
+    // the normal rows are decoded as they are stored, bgr or bgra interleaved, and filtered in one go
+    const int bytespp = normals ? normals->bytespp() : 0;
+
+#pragma omp parallel
+    {
+        // per thread scratch: a ring of three decoded rows per buffer, walked down the thread's contiguous rows
+        FrameArena &arena = frame_arena();
+        const FrameArena::Scope scope(arena);
+        const int scratch = width * std::max(1, bytespp);
+        float *depth_rows[3], *normal_rows[3] = {};
+        for (float *&r: depth_rows) r = arena.allocate<float>(width);
+        if (normals)
+            for (float *&r: normal_rows) r = arena.allocate<float>(scratch);
+        float *s = arena.allocate<float>(scratch), *t = arena.allocate<float>(scratch);
+        float *g2 = normals ? arena.allocate<float>(scratch) : nullptr;
+        float *depth_mag2 = arena.allocate<float>(width), *normal_mag2 = arena.allocate<float>(width);
+        const simd4f depth_threshold4 = simd_set1(depth_threshold2), normal_threshold4 = simd_set1(normal_threshold2);
+        int next = -1; // first row not decoded yet, if the ring holds the rows just above it
+
+#pragma omp for schedule(static)
+        for (int y = 1; y < height - 1; y++)
+        {
+            if (next != y + 1) next = y - 1; // first row of the chunk: fill the whole ring
+            for (; next <= y + 1; next++)
+            {
+                const double *d = depth.data() + static_cast<size_t>(next) * width;
+                float *r = depth_rows[next % 3];
+                for (int x = 0; x < width; x++) r[x] = d[x];
+                if (!normals) continue;
+                const std::uint8_t *p = encoded + static_cast<size_t>(next) * scratch;
+                float *n = normal_rows[next % 3];
+                for (int k = 0; k < scratch; k++) n[k] = p[k]; // one contiguous pass, all the channels at once
+            }
+            const int above = (y - 1) % 3, row = y % 3, below = (y + 1) % 3;
+            sobel_row(depth_rows[above], depth_rows[row], depth_rows[below], s, t, nullptr, depth_mag2, width, 1);
+            if (normals)
+                sobel_row(normal_rows[above], normal_rows[row], normal_rows[below], s, t, g2, normal_mag2, width,
+                          bytespp);
+            // edges are sparse: test 4 pixels at a time, the framebuffer is only touched where one of them is set
+            int x = 1;
+            for (; x + 4 <= width - 1; x += 4)
+            {
+                int mask = simd_mask_gt(simd_loadu(depth_mag2 + x), depth_threshold4);
+                if (normals) mask |= simd_mask_gt(simd_loadu(normal_mag2 + x), normal_threshold4);
+                for (int i = 0; mask; i++, mask >>= 1)
+                    if (mask & 1) framebuffer.set(x + i, y, TGAColor{0, 0, 0, 255});
+            }
+            for (; x < width - 1; x++)
+                if (depth_mag2[x] > depth_threshold2 || (normals && normal_mag2[x] > normal_threshold2))
+                    framebuffer.set(x, y, TGAColor{0, 0, 0, 255});
+        }
+    }
+}
+
+void outline(TGAImage &framebuffer, const std::vector<double> &depth, const double threshold)
+{
+    detect_edges(framebuffer, depth, nullptr, threshold, 0);
+}
+
+void outline(TGAImage &framebuffer, const std::vector<double> &depth, const TGAImage &normals,
+             const double threshold, const double normal_threshold)
+{
+    detect_edges(framebuffer, depth, &normals, threshold, normal_threshold);
+}
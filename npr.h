@@ -0,0 +1,23 @@
+//
+// Created by 25190 on 2026/10/18.
+//
+
+#ifndef NPR_H
+#define NPR_H
+
+#include <vector>
+#include "tgaimage.h"
+
+// non-photorealistic post-processing on the buffers of a finished frame: Sobel edge detection drawn as black
+// outlines. The 3x3 Sobel is run as two separable passes on SIMD rows (1 2 1 smoothing, then -1 0 1 derivative),
+// the gradient is compared squared against the threshold, and the rows are spread over the OpenMP threads.
+
+// depth discontinuities: |Sobel(depth)| > threshold
+void outline(TGAImage &framebuffer, const std::vector<double> &depth, const double threshold = .15);
+
+// depth discontinuities plus creases: normals is a normal buffer (see NormalShader), the normal gradient is the sum of
+// the Sobel of its three components, in normal units (the encoded [0, 255] maps to [-1, 1])
+void outline(TGAImage &framebuffer, const std::vector<double> &depth, const TGAImage &normals,
+             const double threshold = .15, const double normal_threshold = .8);
+
+#endif //NPR_H
@@ -0,0 +1,124 @@
+//
+// Created by 25190 on 2026/10/18.
+//
+
+#include "profiler.h"
+
+#include <algorithm>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace {
+    using profile_clock = std::chrono::steady_clock;
+
+    struct TraceEvent {
+        const char *name;
+        double start_us, duration_us;
+    };
+
+    // written by its own thread only, read by the reports
+    struct ThreadProfile {
+        int tid = 0;
+        long counters[PROF_NCOUNTERS] = {};
+        std::vector<TraceEvent> events = {};
+    };
+
+    constexpr size_t max_events_per_thread = 1 << 20; // later events are dropped, the counters keep counting
+    const char *counter_names[PROF_NCOUNTERS] = {
+        "triangles", "culled_area", "culled_screen", "pixels_tested", "pixels_covered", "pixels_zfail",
+        "fragments", "discarded", "bytes_read", "bytes_written"
+    };
+
+    std::mutex registry_mutex;
+    std::vector<std::shared_ptr<ThreadProfile>> registry; // keeps the data of finished threads alive
+    const profile_clock::time_point epoch = profile_clock::now();
+
+    ThreadProfile &this_thread_profile() {
+        thread_local std::shared_ptr<ThreadProfile> profile = [] {
+            auto p = std::make_shared<ThreadProfile>();
+            std::lock_guard lock(registry_mutex);
+            p->tid = static_cast<int>(registry.size());
+            registry.push_back(p);
+            return p;
+        }();
+        return *profile;
+    }
+}
+
+void profile_count(const ProfileCounter counter, const long n) {
+    this_thread_profile().counters[counter] += n;
+}
+
+ProfileScope::ProfileScope(const char *name) : name(name), start(profile_clock::now()) {
+}
+
+ProfileScope::~ProfileScope() {
+    const auto stop = profile_clock::now();
+    ThreadProfile &profile = this_thread_profile();
+    if (profile.events.size() >= max_events_per_thread) return;
+    profile.events.push_back({
+        name, std::chrono::duration<double, std::micro>(start - epoch).count(),
+        std::chrono::duration<double, std::micro>(stop - start).count()
+    });
+}
+
+void profile_reset() {
+    std::lock_guard lock(registry_mutex);
+    for (auto &profile: registry) {
+        std::fill(profile->counters, profile->counters + PROF_NCOUNTERS, 0);
+        profile->events.clear();
+    }
+}
+
+void profile_summary(std::ostream &out) {
+    std::lock_guard lock(registry_mutex);
+    long counters[PROF_NCOUNTERS] = {};
+    struct ScopeTotal {
+        long calls = 0;
+        double total_us = 0;
+    };
+    std::map<std::string, ScopeTotal> scopes;
+    for (const auto &profile: registry) {
+        for (int i = 0; i < PROF_NCOUNTERS; i++) counters[i] += profile->counters[i];
+        for (const TraceEvent &e: profile->events) {
+            scopes[e.name].calls++;
+            scopes[e.name].total_us += e.duration_us;
+        }
+    }
+    out << "---- counters ----\n";
+    for (int i = 0; i < PROF_NCOUNTERS; i++)
+        out << counter_names[i] << ": " << counters[i] << "\n";
+    out << "---- scopes (calls, total ms, avg us, summed over threads) ----\n";
+    for (const auto &[name, total]: scopes)
+        out << name << ": " << total.calls << ", " << total.total_us / 1000 << ", " << total.total_us / total.calls << "\n";
+}
+
+bool profile_write_trace(const std::string &filename) {
+    std::ofstream out(filename);
+    if (!out.is_open()) return false;
+    std::lock_guard lock(registry_mutex);
+    out << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+    bool first = true;
+    double last_us = 0;
+    long counters[PROF_NCOUNTERS] = {};
+    for (const auto &profile: registry) {
+        for (int i = 0; i < PROF_NCOUNTERS; i++) counters[i] += profile->counters[i];
+        for (const TraceEvent &e: profile->events) {
+            out << (first ? "" : ",\n") << "{\"name\": \"" << e.name << "\", \"cat\": \"render\", \"ph\": \"X\", \"pid\": 1"
+                << ", \"tid\": " << profile->tid << ", \"ts\": " << e.start_us << ", \"dur\": " << e.duration_us << "}";
+            last_us = std::max(last_us, e.start_us + e.duration_us);
+            first = false;
+        }
+    }
+    // the totals as a counter track at the end of the timeline
+    for (int i = 0; i < PROF_NCOUNTERS; i++) {
+        out << (first ? "" : ",\n") << "{\"name\": \"" << counter_names[i] << "\", \"ph\": \"C\", \"pid\": 1, \"ts\": "
+            << last_us << ", \"args\": {\"value\": " << counters[i] << "}}";
+        first = false;
+    }
+    out << "\n]}\n";
+    return out.good();
+}
@@ -0,0 +1,56 @@
+//
+// Created by 25190 on 2026/10/18.
+//
+
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <chrono>
+#include <ostream>
+#include <string>
+
+// pipeline statistics, accumulated per thread and summed when reported
+enum ProfileCounter {
+    PROF_TRIANGLES, // submitted to the triangle setup
+    PROF_CULLED_AREA, // backfacing or smaller than a pixel (det(ABC) < 1)
+    PROF_CULLED_SCREEN, // bounding box outside of the framebuffer
+    PROF_PIXELS_TESTED, // bounding box pixels
+    PROF_PIXELS_COVERED, // inside the triangle
+    PROF_PIXELS_ZFAIL, // rejected by the depth test
+    PROF_FRAGMENTS, // fragment shader invocations
+    PROF_DISCARDED, // fragments discarded by the shader
+    PROF_BYTES_READ, // image files
+    PROF_BYTES_WRITTEN,
+    PROF_NCOUNTERS
+};
+
+void profile_count(const ProfileCounter counter, const long n); // thread-local, no synchronization
+
+// records a trace event from construction to destruction
+struct ProfileScope {
+    const char *name; // must outlive the profiler, string literals only
+    std::chrono::steady_clock::time_point start;
+
+    explicit ProfileScope(const char *name);
+
+    ~ProfileScope();
+};
+
+void profile_reset(); // call while no other thread is recording
+
+void profile_summary(std::ostream &out); // counters + time per scope name
+
+bool profile_write_trace(const std::string &filename); // chrome://tracing or ui.perfetto.dev JSON
+
+// instrumentation points compile to nothing unless GL_PROFILE is defined
+#ifdef GL_PROFILE
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+#define PROFILE_SCOPE(name) ProfileScope PROFILE_CONCAT(profile_scope_, __LINE__)(name)
+#define PROFILE_COUNT(counter, n) profile_count(counter, n)
+#else
+#define PROFILE_SCOPE(name) ((void) 0)
+#define PROFILE_COUNT(counter, n) ((void) sizeof(n)) // unevaluated, only silences unused variable warnings
+#endif
+
+#endif //PROFILER_H
@@ -0,0 +1,337 @@
+//
+// Created by 25190 on 2026/10/18.
+//
+
+#include "render_server.h"
+
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <thread>
+#include <vector>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "frame_arena.h"
+#include "gl_mine.h"
+#include "npr.h"
+#include "shaders.h"
+
+static bool parse_vec3(const std::string &value, vec3 &v)
+{
+    char comma1, comma2;
+    std::istringstream iss(value);
+    return (iss >> v.x >> comma1 >> v.y >> comma2 >> v.z) && comma1 == ',' && comma2 == ',';
+}
+
+bool parse_job(const std::string &line, RenderJob &job, std::string &error)
+{
+    std::istringstream iss(line);
+    std::string token;
+    while (iss >> token)
+    {
+        const size_t eq = token.find('=');
+        if (eq == std::string::npos)
+        {
+            error = "expected key=value, got " + token;
+            return false;
+        }
+        const std::string key = token.substr(0, eq), value = token.substr(eq + 1);
+        bool ok = true;
+        if (key == "model") job.model = value;
+        else if (key == "shader")
+        {
+            job.shader = value;
+            ok = value == "toon" || value == "blinn_phong";
+        }
+        else if (key == "out") job.output = value;
+        else if (key == "eye") ok = parse_vec3(value, job.eye);
+        else if (key == "center") ok = parse_vec3(value, job.center);
+        else if (key == "up") ok = parse_vec3(value, job.up);
+        else if (key == "light") ok = parse_vec3(value, job.light);
+        else if (key == "outline")
+        {
+            job.outline = value != "0";
+            job.normal_edges = value == "normals";
+        }
+        else if (key == "textures")
+        {
+            job.compressed_textures = value == "bc";
+            ok = value == "bc" || value == "raw";
+        }
+        else if (key == "size")
+        {
+            char x;
+            std::istringstream size(value);
+            ok = (size >> job.width >> x >> job.height) && x == 'x' && job.width > 0 && job.height > 0
+                 && job.width <= max_job_size && job.height <= max_job_size;
+        }
+        else ok = false;
+        if (!ok)
+        {
+            error = "bad value for " + token;
+            return false;
+        }
+    }
+    if (job.model.empty())
+    {
+        error = "no model";
+        return false;
+    }
+    return true;
+}
+
+std::shared_ptr<const Model> AssetCache::get(const std::string &path, const bool compressed_textures)
+{
+    const std::string key = compressed_textures ? path + "#bc" : path;
+    std::unique_lock lock(mutex);
+    auto it = entries.find(key);
+    if (it != entries.end())
+    {
+        hits++;
+        lru.splice(lru.begin(), lru, it->second.lru); // move to the front
+        const auto model = it->second.model;
+        lock.unlock();
+        return model.get(); // waits if another worker is still loading it
+    }
+
+    misses++;
+    std::promise<std::shared_ptr<const Model>> promise;
+    const long generation = ++generations;
+    lru.push_front(key);
+    entries[key] = {promise.get_future().share(), lru.begin(), generation};
+    while (lru.size() > capacity) // the jobs still using an evicted model keep it alive
+    {
+        entries.erase(lru.back());
+        lru.pop_back();
+    }
+    lock.unlock();
+
+    std::shared_ptr<const Model> model;
+    try
+    {
+        model = std::make_shared<const Model>(path, 1, compressed_textures); // load outside of the lock
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << "loading " << path << ": " << e.what() << std::endl;
+    }
+    if (model && !model->nfaces()) model = nullptr;
+    if (!model)
+    {
+        lock.lock();
+        it = entries.find(key);
+        // don't cache failures, the file may show up later; the entry may have been evicted and reloaded meanwhile
+        if (it != entries.end() && it->second.generation == generation)
+        {
+            lru.erase(it->second.lru);
+            entries.erase(it);
+        }
+        lock.unlock();
+    }
+    promise.set_value(model);
+    return model;
+}
+
+long AssetCache::nhits()
+{
+    std::lock_guard lock(mutex);
+    return hits;
+}
+
+long AssetCache::nmisses()
+{
+    std::lock_guard lock(mutex);
+    return misses;
+}
+
+RenderServer::RenderServer(const int nworkers, const size_t cache_capacity) : cache(cache_capacity),
+    nworkers(std::max(1, nworkers))
+{
+}
+
+// hands a target back to the cache when the job is done, or throws
+struct TargetLease
+{
+    RenderTargetCache &cache;
+    RenderTarget &target;
+
+    TargetLease(RenderTargetCache &cache, RenderTarget &target) : cache(cache), target(target) {}
+
+    ~TargetLease() { cache.release(target); }
+
+    TargetLease(const TargetLease &) = delete;
+
+    TargetLease &operator=(const TargetLease &) = delete;
+};
+
+bool RenderServer::render(const RenderJob &job)
+{
+    const std::shared_ptr<const Model> model = cache.get(job.model, job.compressed_textures);
+    if (!model)
+    {
+        std::cerr << "can't load model " << job.model << std::endl;
+        return false;
+    }
+
+    // this thread's "OpenGL" state, other workers have their own
+    lookat(job.eye, job.center, job.up);
+    init_perspective(norm(job.eye - job.center));
+    init_viewport(job.width / 16, job.height / 16, job.width * 7 / 8, job.height * 7 / 8);
+
+    RenderTarget &target = targets.acquire(job.width, job.height, TGAImage::RGB);
+    const TargetLease lease(targets, target);
+    target.clear({177, 195, 209, 255});
+    if (job.shader == "blinn_phong")
+    {
+        BlinnPhongShader shader(job.light, job.eye - job.center, *model);
+        draw(model->nfaces(), shader, target.color, target.depth);
+    }
+    else
+    {
+        ToonShader shader(vec4{22 * 4, 56 * 4, 147 * 4, 255}, job.light, *model);
+        draw(model->nfaces(), shader, target.color, target.depth);
+    }
+    if (job.outline && job.normal_edges)
+    {
+        RenderTarget &normals = targets.acquire(job.width, job.height, TGAImage::RGB);
+        const TargetLease normals_lease(targets, normals);
+        normals.clear({0, 0, 0, 255});
+        NormalShader shader(*model);
+        draw(model->nfaces(), shader, normals.color, normals.depth);
+        outline(target.color, target.depth, normals.color);
+    }
+    else if (job.outline) outline(target.color, target.depth);
+    const bool ok = target.color.write_tga_file(job.output);
+    frame_arena().reset();
+    return ok;
+}
+
+void RenderServer::worker()
+{
+#ifdef _OPENMP
+    omp_set_num_threads(1); // the parallelism is across jobs, don't oversubscribe the cores
+#endif
+    while (true)
+    {
+        std::pair<int, RenderJob> job;
+        {
+            std::unique_lock lock(mutex);
+            pending.wait(lock, [this] { return closed || !queue.empty(); });
+            if (queue.empty()) return; // closed and drained
+            job = std::move(queue.front());
+            queue.pop_front();
+        }
+        const auto start = std::chrono::steady_clock::now();
+        bool ok = false;
+        std::string error;
+        try
+        {
+            ok = render(job.second);
+        }
+        catch (const std::exception &e) // e.g. bad_alloc, a job must not take the server down
+        {
+            error = e.what();
+        }
+        const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        std::lock_guard lock(mutex);
+        failures += !ok;
+        std::cerr << "job " << job.first << " " << (ok ? "done" : "FAILED") << ": " << job.second.output
+                  << " in " << ms << "ms" << (error.empty() ? "" : " (" + error + ")") << std::endl;
+    }
+}
+
+void RenderServer::submit(const int id, const RenderJob &job)
+{
+    {
+        std::lock_guard lock(mutex);
+        queue.emplace_back(id, job);
+    }
+    pending.notify_one();
+}
+
+int RenderServer::read_jobs(std::istream &in, int &next_id)
+{
+    int njobs = 0;
+    std::string line;
+    while (std::getline(in, line))
+    {
+        line.erase(0, line.find_first_not_of(" \t"));
+        if (line.empty() || line[0] == '#') continue;
+        if (line.rfind("quit", 0) == 0) return -1;
+        RenderJob job;
+        std::string error;
+        if (!parse_job(line, job, error))
+        {
+            std::lock_guard lock(mutex);
+            failures++;
+            std::cerr << "rejected job \"" << line << "\": " << error << std::endl;
+            continue;
+        }
+        submit(next_id++, job);
+        njobs++;
+    }
+    return njobs;
+}
+
+int RenderServer::run(const std::string &source)
+{
+    namespace fs = std::filesystem;
+    const auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> workers;
+    for (int i = 0; i < nworkers; i++)
+        workers.emplace_back(&RenderServer::worker, this);
+
+    int next_id = 0;
+    std::error_code ec;
+    if (source == "-")
+        read_jobs(std::cin, next_id);
+    else if (!fs::is_directory(source, ec))
+    {
+        std::ifstream in(source);
+        if (!in.is_open()) std::cerr << "can't open spool file " << source << std::endl;
+        read_jobs(in, next_id);
+    }
+    else
+    {
+        // spool directory: claim each *.job file by renaming it, so that several servers can share a spool
+        bool quit = false;
+        while (!quit)
+        {
+            std::vector<fs::path> spooled;
+            for (const auto &entry: fs::directory_iterator(source, ec))
+                if (entry.path().extension() == ".job") spooled.push_back(entry.path());
+            std::sort(spooled.begin(), spooled.end());
+            for (const fs::path &path: spooled)
+            {
+                fs::path claimed = path;
+                claimed += ".taken";
+                fs::rename(path, claimed, ec);
+                if (ec) continue; // taken by someone else
+                std::ifstream in(claimed);
+                quit = read_jobs(in, next_id) < 0;
+                in.close();
+                fs::rename(claimed, fs::path(path).replace_extension(".done"), ec);
+                if (quit) break;
+            }
+            if (!quit) std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        }
+    }
+
+    {
+        std::lock_guard lock(mutex);
+        closed = true;
+    }
+    pending.notify_all();
+    for (std::thread &t: workers) t.join();
+
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cerr << next_id << " jobs, " << failures << " failed, " << seconds << "s (" << next_id / seconds
+              << " jobs/s), model cache " << cache.nhits() << " hits / " << cache.nmisses() << " misses, "
+              << targets.size() << " render targets (" << targets.bytes() / (1024 * 1024) << "MB), peak RSS " << peak_rss_kb() / 1024 << "MB" << std::endl;
+    return failures;
+}
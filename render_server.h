@@ -0,0 +1,95 @@
+//
+// Created by 25190 on 2026/10/18.
+//
+
+#ifndef RENDER_SERVER_H
+#define RENDER_SERVER_H
+
+#include <condition_variable>
+#include <deque>
+#include <future>
+#include <istream>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include "geometry.h"
+#include "gl_mine.h"
+#include "Model.h"
+
+// one image to render, parsed from a line of key=value pairs, e.g.
+// model=../Obj/african_head.obj shader=blinn_phong eye=-1,0,2 size=800x800 textures=bc out=head.tga
+struct RenderJob {
+    std::string model;
+    std::string shader = "toon"; // toon | blinn_phong
+    std::string output = "framebuffer.tga";
+    vec3 eye = {-1, 0, 2};
+    vec3 center = {0, 0, 0};
+    vec3 up = {0, 1, 0};
+    vec3 light = {1, 1, 1};
+    int width = 800, height = 800;
+    bool outline = true;
+    bool normal_edges = false; // outline=normals: creases from a normal buffer on top of the depth edges
+    bool compressed_textures = false; // textures=bc: block-compressed textures, textures=raw (default) otherwise
+};
+
+constexpr int max_job_size = 8192; // per side, larger images are rejected by parse_job()
+
+bool parse_job(const std::string &line, RenderJob &job, std::string &error);
+
+// models (with their textures) shared by the jobs, the least recently used one is dropped beyond capacity;
+// concurrent requests for the same file wait for a single load
+class AssetCache {
+    struct Entry {
+        std::shared_future<std::shared_ptr<const Model>> model;
+        std::list<std::string>::iterator lru;
+        long generation; // tells a reloaded entry from the one a failed load inserted
+    };
+
+    const size_t capacity;
+    std::list<std::string> lru = {}; // most recently used first
+    std::unordered_map<std::string, Entry> entries = {};
+    std::mutex mutex;
+    long hits = 0, misses = 0;
+    long generations = 0;
+
+public:
+    explicit AssetCache(const size_t capacity) : capacity(capacity) {}
+
+    // nullptr if the model can't be loaded; the raw and compressed flavors of a model are two entries
+    std::shared_ptr<const Model> get(const std::string &path, const bool compressed_textures = false);
+
+    long nhits();
+
+    long nmisses();
+};
+
+// long-running headless mode: reads jobs from a stream or a spool directory and renders them on a pool of workers
+class RenderServer {
+    AssetCache cache;
+    RenderTargetCache targets; // framebuffers reused across jobs of the same size, idle ones within the default budget
+    const int nworkers;
+    std::deque<std::pair<int, RenderJob>> queue = {};
+    std::mutex mutex;
+    std::condition_variable pending;
+    bool closed = false;
+    int failures = 0;
+
+    void worker();
+
+    bool render(const RenderJob &job); // on the calling thread
+
+    void submit(const int id, const RenderJob &job);
+
+    int read_jobs(std::istream &in, int &next_id); // returns -1 once a "quit" line has been read
+
+public:
+    RenderServer(const int nworkers, const size_t cache_capacity);
+
+    // source: "-" for stdin, a spool file (read once) or a spool directory (polled for *.job files until a
+    // "quit" line shows up); returns the number of failed jobs
+    int run(const std::string &source);
+};
+
+#endif //RENDER_SERVER_H
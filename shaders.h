@@ -0,0 +1,170 @@
+//
+// Created by 25190 on 2026/10/18.
+//
+
+#ifndef SHADERS_H
+#define SHADERS_H
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#include "gl_mine.h"
+#include "Model.h"
+
+// cel shading: quantized diffuse lighting with a flat color, tinted by the instance color when instanced
+struct ToonShader : IShader
+{
+    const gl_vec4 color;
+    const Model &model;
+    const gl_vec4 l; // light direction in eye coordinates
+
+    ToonShader(const gl_vec4 color, const vec3 light, const Model &m) : color(color), model(m),
+        l(normalized(uniforms.ModelView * vec4{light.x, light.y, light.z, 0.})) // transform the light vector to view coordinates
+    {
+    }
+
+    virtual int nvaryings() const { return 1; } // varying[0]: normal to be interpolated by the fragment shader
+
+    virtual int nflat() const { return 1; } // varying[1]: tint
+
+    virtual gl_vec4 vertex(const int face, const int vert, Varyings &varying) const
+    {
+        varying[0] = uniforms.NormalMatrix * model.normal(face, vert);
+        varying[1] = vec4{1, 1, 1, 1};
+        gl_vec4 gl_Position = uniforms.ModelView * model.vert(face, vert);
+        return uniforms.Perspective * gl_Position;
+    }
+
+    virtual gl_vec4 vertex_instanced(const InstanceUniforms &instance, const int face, const int vert,
+                                     Varyings &varying) const
+    {
+        varying[0] = instance.NormalMatrix * model.normal(face, vert);
+        varying[1] = instance.color;
+        gl_vec4 gl_Position = instance.ModelView * model.vert(face, vert);
+        return uniforms.Perspective * gl_Position;
+    }
+
+    virtual std::pair<bool, TGAColor> fragment(const Varyings &varying) const
+    {
+        gl_vec4 n = normalized(varying[0]);
+        // per-vertex normal interpolation
+
+        gl_real diffuse = std::max<gl_real>(0, n * l); // diffuse light intensity
+
+        gl_real intensity = .15 + diffuse; // a bit of ambient light + diffuse light
+        if (intensity > .66) intensity = 1;
+        else if (intensity > .33) intensity = .66;
+        else intensity = .33;
+
+        TGAColor gl_FragColor;
+        for (int channel: {0, 1, 2})
+            gl_FragColor[channel] = std::min<int>(255, color[channel] * varying[1][channel] * intensity);
+        return {false, gl_FragColor}; // do not discard the pixel
+    }
+};
+
+// Blinn-Phong with diffuse, specular and tangent space normal maps (see Lesson_8_TBN), tinted by the instance color
+// when instanced
+struct BlinnPhongShader : IShader
+{
+    const Model &model;
+    const gl_vec4 l; // light direction in eye coordinates
+    const gl_vec4 h; // half vector in eye coordinates
+
+    BlinnPhongShader(const vec3 light, const vec3 eye, const Model &m) : model(m),
+        l(normalized(uniforms.ModelView * vec4{light.x, light.y, light.z, 0.})),
+        h(normalized(l + normalized(uniforms.ModelView * vec4{eye.x, eye.y, eye.z, 0.})))
+    {
+    }
+
+    // varying[0]: normal, varying[1]: tangent, varying[2]: bitangent, varying[3].xy: uv
+    virtual int nvaryings() const { return 4; }
+
+    virtual gl_vec4 vertex(const int face, const int vert, Varyings &varying) const
+    {
+        return shade_vertex(uniforms.ModelView, uniforms.NormalMatrix, face, vert, varying);
+    }
+
+    virtual gl_vec4 vertex_instanced(const InstanceUniforms &instance, const int face, const int vert,
+                                     Varyings &varying) const
+    {
+        return shade_vertex(instance.ModelView, instance.NormalMatrix, face, vert, varying);
+    }
+
+    gl_vec4 shade_vertex(const gl_mat4 &ModelView, const gl_mat4 &NormalMatrix, const int face, const int vert,
+                         Varyings &varying) const
+    {
+        // tangent and bitangent of the face, derived from its edges and their uv, same for its 3 vertices
+        mat<2, 4> E = {model.vert(face, 1) - model.vert(face, 0), model.vert(face, 2) - model.vert(face, 0)};
+        mat<2, 2> U = {model.uv(face, 1) - model.uv(face, 0), model.uv(face, 2) - model.uv(face, 0)};
+        mat<2, 4> T = U.invert() * E;
+
+        const vec2 uv = model.uv(face, vert);
+        varying[0] = NormalMatrix * model.normal(face, vert);
+        varying[1] = ModelView * T[0];
+        varying[2] = ModelView * T[1];
+        varying[3] = gl_vec4{uv.x, uv.y, 0, 0};
+        gl_vec4 gl_Position = ModelView * model.vert(face, vert);
+        return uniforms.Perspective * gl_Position;
+    }
+
+    virtual std::pair<bool, TGAColor> fragment(const Varyings &varying) const
+    {
+        gl_mat4 D = {normalized(varying[1]), // tangent vector
+                     normalized(varying[2]), // bitangent vector
+                     normalized(varying[0]), // interpolated normal
+                     {0, 0, 0, 1}}; // Darboux frame
+
+        const vec2 uv = varying[3].xy();
+        gl_vec4 n = normalized(D.transpose() * model.normal(uv));
+        gl_real ambient = .5; // ambient light intensity
+        gl_real diff = std::max<gl_real>(0, n * l); // diffuse light intensity
+        gl_real spec = std::pow(std::max<gl_real>(n * h, 0), 70); // specular intensity
+        spec *= (3. * sample2D(model.specular(), uv)[0] / 255.);
+        const InstanceUniforms *tint = instance(); // no varyings slot left for the instance color
+        TGAColor gl_FragColor = sample2D(model.diffuse(), uv);
+        for (int channel: {0, 1, 2})
+            gl_FragColor[channel] = std::min<int>(255, gl_FragColor[channel] * (tint ? tint->color[channel] : 1)
+                                                       * (ambient + diff + spec));
+        return {false, gl_FragColor}; // do not discard the pixel
+    }
+};
+
+// normal buffer for the NPR post-processing (see npr.h): the view space normal, [-1, 1] encoded as [0, 255] in
+// the RGB channels; the background is left as cleared
+struct NormalShader : IShader
+{
+    const Model &model;
+
+    explicit NormalShader(const Model &m) : model(m)
+    {
+    }
+
+    virtual int nvaryings() const { return 1; } // varying[0]: normal
+
+    virtual gl_vec4 vertex(const int face, const int vert, Varyings &varying) const
+    {
+        varying[0] = uniforms.NormalMatrix * model.normal(face, vert);
+        gl_vec4 gl_Position = uniforms.ModelView * model.vert(face, vert);
+        return uniforms.Perspective * gl_Position;
+    }
+
+    virtual gl_vec4 vertex_instanced(const InstanceUniforms &instance, const int face, const int vert,
+                                     Varyings &varying) const
+    {
+        varying[0] = instance.NormalMatrix * model.normal(face, vert);
+        gl_vec4 gl_Position = instance.ModelView * model.vert(face, vert);
+        return uniforms.Perspective * gl_Position;
+    }
+
+    virtual std::pair<bool, TGAColor> fragment(const Varyings &varying) const
+    {
+        const gl_vec4 n = normalized(varying[0]);
+        TGAColor gl_FragColor = {0, 0, 0, 255};
+        for (int channel: {0, 1, 2}) // bgra: x in red, y in green, z in blue
+            gl_FragColor[2 - channel] = std::clamp<int>(std::lround((n[channel] + 1) * 255 / 2), 0, 255);
+        return {false, gl_FragColor};
+    }
+};
+
+#endif //SHADERS_H
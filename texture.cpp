@@ -0,0 +1,264 @@
+//
+// Created by 25190 on 2026/10/18.
+//
+
+#include "texture.h"
+#include "profiler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <random>
+
+// ---- encoding: one 4x4 block at a time, texels outside of the image are clamped to its edges ----
+
+static void gather_block(const TGAImage &image, const int bx, const int by, TGAColor texels[16]) {
+    for (int j = 0; j < 4; j++)
+        for (int i = 0; i < 4; i++)
+            texels[i + j * 4] = image.get(std::min(bx * 4 + i, image.width() - 1),
+                                          std::min(by * 4 + j, image.height() - 1));
+}
+
+static std::uint16_t pack565(const double r, const double g, const double b) {
+    auto q = [](const double v, const int max) { return std::clamp<int>(std::lround(v * max / 255.), 0, max); };
+    return q(r, 31) << 11 | q(g, 63) << 5 | q(b, 31);
+}
+
+static void unpack565(const std::uint16_t c, int rgb[3]) {
+    const int r = c >> 11 & 31, g = c >> 5 & 63, b = c & 31;
+    rgb[0] = r << 3 | r >> 2;
+    rgb[1] = g << 2 | g >> 4;
+    rgb[2] = b << 3 | b >> 2;
+}
+
+// endpoints at the extremities of the principal axis of the block colors, indices to the nearest palette entry
+static void encode_bc1(const TGAColor texels[16], std::uint8_t *out) {
+    double rgb[16][3], mean[3] = {0, 0, 0};
+    for (int t = 0; t < 16; t++)
+        for (int c = 0; c < 3; c++) {
+            rgb[t][c] = texels[t][2 - c]; // BGR => RGB
+            mean[c] += rgb[t][c] / 16;
+        }
+    double cov[6] = {0, 0, 0, 0, 0, 0}; // rr rg rb gg gb bb
+    for (auto &p: rgb) {
+        const double d[3] = {p[0] - mean[0], p[1] - mean[1], p[2] - mean[2]};
+        cov[0] += d[0] * d[0], cov[1] += d[0] * d[1], cov[2] += d[0] * d[2];
+        cov[3] += d[1] * d[1], cov[4] += d[1] * d[2], cov[5] += d[2] * d[2];
+    }
+    double axis[3] = {1, 1, 1};
+    for (int iter = 0; iter < 8; iter++) { // power iteration
+        const double a[3] = {cov[0] * axis[0] + cov[1] * axis[1] + cov[2] * axis[2],
+                             cov[1] * axis[0] + cov[3] * axis[1] + cov[4] * axis[2],
+                             cov[2] * axis[0] + cov[4] * axis[1] + cov[5] * axis[2]};
+        const double n = std::sqrt(a[0] * a[0] + a[1] * a[1] + a[2] * a[2]);
+        if (n < 1e-9) break; // flat block, any axis will do
+        for (int c = 0; c < 3; c++) axis[c] = a[c] / n;
+    }
+    double tmin = 1e30, tmax = -1e30;
+    for (auto &p: rgb) {
+        const double t = (p[0] - mean[0]) * axis[0] + (p[1] - mean[1]) * axis[1] + (p[2] - mean[2]) * axis[2];
+        tmin = std::min(tmin, t);
+        tmax = std::max(tmax, t);
+    }
+    std::uint16_t c0 = pack565(mean[0] + axis[0] * tmax, mean[1] + axis[1] * tmax, mean[2] + axis[2] * tmax);
+    std::uint16_t c1 = pack565(mean[0] + axis[0] * tmin, mean[1] + axis[1] * tmin, mean[2] + axis[2] * tmin);
+    if (c0 < c1) std::swap(c0, c1); // c0 > c1 selects the 4 color mode
+    int palette[4][3];
+    unpack565(c0, palette[0]);
+    unpack565(c1, palette[1]);
+    for (int c = 0; c < 3; c++) {
+        palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+        palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+    }
+    std::uint32_t indices = 0;
+    for (int t = 0; t < 16 && c0 != c1; t++) {
+        int best = 0, best_d2 = 1 << 30;
+        for (int k = 0; k < 4; k++) {
+            int d2 = 0;
+            for (int c = 0; c < 3; c++) d2 += (palette[k][c] - rgb[t][c]) * (palette[k][c] - rgb[t][c]);
+            if (d2 < best_d2) best = k, best_d2 = d2;
+        }
+        indices |= static_cast<std::uint32_t>(best) << (2 * t);
+    }
+    out[0] = c0 & 255, out[1] = c0 >> 8, out[2] = c1 & 255, out[3] = c1 >> 8;
+    for (int i = 0; i < 4; i++) out[4 + i] = indices >> (8 * i) & 255;
+}
+
+// channel of the 16 texels => min/max endpoints (8 value mode), indices to the nearest of the 8 values
+static void encode_bc4(const TGAColor texels[16], const int channel, std::uint8_t *out) {
+    int lo = 255, hi = 0;
+    for (int t = 0; t < 16; t++) {
+        lo = std::min<int>(lo, texels[t][channel]);
+        hi = std::max<int>(hi, texels[t][channel]);
+    }
+    out[0] = hi, out[1] = lo; // e0 > e1 selects the 8 value mode
+    std::uint64_t indices = 0;
+    for (int t = 0; t < 16 && hi > lo; t++) {
+        // palette: 0 => hi, 1 => lo, 2..7 => (8-i)/7 hi + (i-1)/7 lo
+        const int step = std::lround(7. * (hi - texels[t][channel]) / (hi - lo)); // 0 = hi ... 7 = lo
+        const int index = step == 0 ? 0 : step == 7 ? 1 : step + 1;
+        indices |= static_cast<std::uint64_t>(index) << (3 * t);
+    }
+    for (int i = 0; i < 6; i++) out[2 + i] = indices >> (8 * i) & 255;
+}
+
+// ---- decoding of a single texel ----
+
+static int decode_bc4(const std::uint8_t *block, const int t) {
+    const int e0 = block[0], e1 = block[1];
+    const int bit = 3 * t;
+    const int byte = 2 + bit / 8, shift = bit % 8;
+    const int index = ((block[byte] | (byte + 1 < 8 ? block[byte + 1] << 8 : 0)) >> shift) & 7;
+    if (index < 2) return index ? e1 : e0;
+    if (e0 > e1) return ((8 - index) * e0 + (index - 1) * e1) / 7;
+    if (index >= 6) return index == 6 ? 0 : 255;
+    return ((6 - index) * e0 + (index - 1) * e1) / 5;
+}
+
+int Texture::block_bytes() const {
+    return fmt == TextureFormat::BC5 ? 16 : 8;
+}
+
+Texture::Texture(TGAImage image) : raw(std::move(image)), w(raw.width()), h(raw.height()) {
+}
+
+Texture::Texture(const TGAImage &image, const TextureFormat format) : fmt(format), w(image.width()),
+                                                                      h(image.height()) {
+    if (format == TextureFormat::RAW) {
+        raw = image;
+        return;
+    }
+    PROFILE_SCOPE("Texture::encode");
+    const int bw = (w + 3) / 4, bh = (h + 3) / 4;
+    blocks.assign(static_cast<size_t>(bw) * bh * block_bytes(), 0);
+#pragma omp parallel for schedule(static)
+    for (int by = 0; by < bh; by++) {
+        for (int bx = 0; bx < bw; bx++) {
+            TGAColor texels[16];
+            gather_block(image, bx, by, texels);
+            std::uint8_t *out = blocks.data() + (static_cast<size_t>(bx) + by * bw) * block_bytes();
+            if (format == TextureFormat::BC1) encode_bc1(texels, out);
+            else if (format == TextureFormat::BC4) encode_bc4(texels, 0, out);
+            else {
+                encode_bc4(texels, 2, out); // red => x
+                encode_bc4(texels, 1, out + 8); // green => y
+            }
+        }
+    }
+}
+
+TGAColor Texture::get(const int x, const int y) const {
+    if (fmt == TextureFormat::RAW) return raw.get(x, y);
+    if (blocks.empty() || x < 0 || y < 0 || x >= w || y >= h) return {};
+    const std::uint8_t *block = blocks.data() + (static_cast<size_t>(x / 4) + (y / 4) * ((w + 3) / 4)) * block_bytes();
+    const int t = (x & 3) + (y & 3) * 4; // texel within the block
+    switch (fmt) {
+        case TextureFormat::BC1: {
+            const std::uint16_t c0 = block[0] | block[1] << 8, c1 = block[2] | block[3] << 8;
+            const int index = block[4 + (t >> 2)] >> (2 * (t & 3)) & 3;
+            int e0[3], e1[3], rgb[3];
+            unpack565(c0, e0);
+            unpack565(c1, e1);
+            for (int c = 0; c < 3; c++) {
+                if (index < 2) rgb[c] = index ? e1[c] : e0[c];
+                else if (c0 > c1) rgb[c] = index == 2 ? (2 * e0[c] + e1[c]) / 3 : (e0[c] + 2 * e1[c]) / 3;
+                else rgb[c] = index == 2 ? (e0[c] + e1[c]) / 2 : 0;
+            }
+            return {{static_cast<std::uint8_t>(rgb[2]), static_cast<std::uint8_t>(rgb[1]),
+                     static_cast<std::uint8_t>(rgb[0]), 255}, 3};
+        }
+        case TextureFormat::BC4: {
+            const auto v = static_cast<std::uint8_t>(decode_bc4(block, t));
+            return {{v, v, v, 255}, 1};
+        }
+        default: { // BC5: unit normal => z from x and y
+            const int x8 = decode_bc4(block, t), y8 = decode_bc4(block + 8, t);
+            const double nx = x8 * 2. / 255. - 1, ny = y8 * 2. / 255. - 1;
+            const double nz = std::sqrt(std::max(0., 1 - nx * nx - ny * ny));
+            return {{static_cast<std::uint8_t>(std::lround((nz + 1) * 255. / 2)), static_cast<std::uint8_t>(y8),
+                     static_cast<std::uint8_t>(x8), 255}, 3};
+        }
+    }
+}
+
+size_t Texture::bytes() const {
+    if (fmt != TextureFormat::RAW) return blocks.size();
+    return static_cast<size_t>(w) * h * (w && h ? raw.get(0, 0).bytespp : 0);
+}
+
+// .blk file: "BLK1", format, width, height (int32 each, little endian as on the machines we run on), blocks
+bool Texture::write_blocks(const std::string &filename) const {
+    if (fmt == TextureFormat::RAW) return false;
+    // same directory => same file system, the rename replaces the cache in one step
+    const std::string temporary = filename + "." + std::to_string(std::random_device{}()) + ".tmp";
+    std::ofstream out(temporary, std::ios::binary);
+    const std::int32_t header[3] = {static_cast<std::int32_t>(fmt), w, h};
+    out.write("BLK1", 4);
+    out.write(reinterpret_cast<const char *>(header), sizeof(header));
+    out.write(reinterpret_cast<const char *>(blocks.data()), blocks.size());
+    out.close();
+    std::error_code ec;
+    if (out.good()) {
+        std::filesystem::rename(temporary, filename, ec);
+        if (!ec) return true;
+    }
+    std::filesystem::remove(temporary, ec);
+    return false;
+}
+
+bool Texture::read_blocks(const std::string &filename, const TextureFormat format) {
+    std::ifstream in(filename, std::ios::binary);
+    char magic[4];
+    std::int32_t header[3];
+    in.read(magic, 4);
+    in.read(reinterpret_cast<char *>(header), sizeof(header));
+    if (!in.good() || std::memcmp(magic, "BLK1", 4) || header[0] != static_cast<std::int32_t>(format)
+        || format == TextureFormat::RAW || header[1] <= 0 || header[2] <= 0)
+        return false;
+    const size_t size = static_cast<size_t>((header[1] + 3) / 4) * ((header[2] + 3) / 4)
+                        * (format == TextureFormat::BC5 ? 16 : 8); // block_bytes() of format
+    std::error_code ec;
+    if (std::filesystem::file_size(filename, ec) != 4 + sizeof(header) + size || ec) return false; // truncated
+    fmt = format;
+    w = header[1];
+    h = header[2];
+    raw = {};
+    blocks.assign(size, 0);
+    in.read(reinterpret_cast<char *>(blocks.data()), blocks.size());
+    if (in.good()) return true;
+    *this = {};
+    return false;
+}
+
+bool Texture::load(const std::string &filename, const TextureFormat format) {
+    namespace fs = std::filesystem;
+    const std::string cache = filename + ".blk";
+    std::error_code ec, ec_cache;
+    if (format != TextureFormat::RAW && fs::last_write_time(cache, ec_cache) >= fs::last_write_time(filename, ec)
+        && !ec && !ec_cache && read_blocks(cache, format))
+        return true;
+    TGAImage image;
+    if (!image.read_tga_file(filename)) {
+        *this = {};
+        return false;
+    }
+    if (format == TextureFormat::RAW) {
+        *this = Texture(std::move(image));
+        return true;
+    }
+    *this = Texture(image, format);
+    if (!write_blocks(cache)) std::cerr << "can't write the block cache " << cache << "\n"; // not fatal
+    return true;
+}
+
+const char *texture_format_name(const TextureFormat format) {
+    switch (format) {
+        case TextureFormat::BC1: return "bc1";
+        case TextureFormat::BC4: return "bc4";
+        case TextureFormat::BC5: return "bc5";
+        default: return "raw";
+    }
+}
@@ -0,0 +1,62 @@
+//
+// Created by 25190 on 2026/10/18.
+//
+
+#ifndef TEXTURE_H
+#define TEXTURE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "tgaimage.h"
+
+// storage of a texture: the decoded TGA pixels, or 4x4 blocks in the layout of the GPU formats of the same name
+enum class TextureFormat {
+    RAW, // TGAImage as loaded, 8-32 bits per texel
+    BC1, // color: two RGB565 endpoints + 2-bit indices, 4 bits per texel, no alpha
+    BC4, // one channel (the first one): two 8-bit endpoints + 3-bit indices, 4 bits per texel
+    BC5, // two channels (red, green => tangent space normal x, y; z is rebuilt when sampling), 8 bits per texel
+};
+
+// a texture sampled by the shaders, either raw or block-compressed; a compressed texel is decoded on the fly from its
+// block, nothing else is ever decompressed
+class Texture {
+    TextureFormat fmt = TextureFormat::RAW;
+    TGAImage raw = {};
+    int w = 0, h = 0;
+    std::vector<std::uint8_t> blocks = {}; // row-major 4x4 blocks, the right and bottom ones padded by edge texels
+
+    int block_bytes() const; // 8 or 16
+
+public:
+    Texture() = default;
+
+    explicit Texture(TGAImage image); // raw
+
+    Texture(const TGAImage &image, const TextureFormat format); // encodes image
+
+    // loads a .tga file into format; the blocks are cached on disk next to it (filename + ".blk") and the cache is
+    // used as long as it is newer than the .tga file
+    bool load(const std::string &filename, const TextureFormat format);
+
+    // written to a temporary file then renamed over filename: concurrent loaders never see a partial cache
+    bool write_blocks(const std::string &filename) const;
+
+    // fails on anything but a complete cache of format
+    bool read_blocks(const std::string &filename, const TextureFormat format);
+
+    TGAColor get(const int x, const int y) const; // same as TGAImage::get(), {} outside of the texture
+
+    int width() const { return w; }
+
+    int height() const { return h; }
+
+    TextureFormat format() const { return fmt; }
+
+    size_t bytes() const; // memory taken by the texels
+};
+
+const char *texture_format_name(const TextureFormat format);
+
+#endif //TEXTURE_H
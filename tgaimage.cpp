@@ -3,17 +3,20 @@
 //
 
 #include "tgaimage.h"
+#include "profiler.h"
 #include <iostream>
 #include <cstring>
+#include <algorithm>
 
 TGAImage::TGAImage(const int w, const int h, const int bpp, TGAColor c) : w(w), h(h), bpp(bpp),
-                                                                          data(w * h * bpp, 0) {
+                                                                          data(static_cast<size_t>(w) * h * bpp, 0) {
     for (int j = 0; j < h; j++)
         for (int i = 0; i < w; i++)
             set(i, j, c);
 }
 
 bool TGAImage::read_tga_file(const std::string filename) {
+    PROFILE_SCOPE("TGAImage::read_tga_file");
     std::ifstream in;
     in.open(filename, std::ios::binary);
     if (!in.is_open()) {
@@ -54,11 +57,13 @@ bool TGAImage::read_tga_file(const std::string filename) {
         flip_vertically();
     if (header.imagedescriptor & 0x10)
         flip_horizontally();
+    PROFILE_COUNT(PROF_BYTES_READ, static_cast<long>(in.tellg()));
     std::cerr << w << "x" << h << "/" << bpp * 8 << "\n";
     return true;
 }
 
 bool TGAImage::load_rle_data(std::ifstream &in) {
+    PROFILE_SCOPE("TGAImage::load_rle_data");
     size_t pixelcount = w * h;
     size_t currentpixel = 0;
     size_t currentbyte = 0;
@@ -108,6 +113,7 @@ bool TGAImage::load_rle_data(std::ifstream &in) {
 }
 
 bool TGAImage::write_tga_file(const std::string filename, const bool vflip, const bool rle) const {
+    PROFILE_SCOPE("TGAImage::write_tga_file");
     constexpr std::uint8_t developer_area_ref[4] = {0, 0, 0, 0};
     constexpr std::uint8_t extension_area_ref[4] = {0, 0, 0, 0};
     constexpr std::uint8_t footer[18] = {
@@ -137,6 +143,7 @@ bool TGAImage::write_tga_file(const std::string filename, const bool vflip, cons
     if (!out.good()) goto err;
     out.write(reinterpret_cast<const char *>(footer), sizeof(footer));
     if (!out.good()) goto err;
+    PROFILE_COUNT(PROF_BYTES_WRITTEN, static_cast<long>(out.tellp()));
     return true;
     err:
     std::cerr << "can't dump the tga file\n";
@@ -144,6 +151,7 @@ bool TGAImage::write_tga_file(const std::string filename, const bool vflip, cons
 }
 
 bool TGAImage::unload_rle_data(std::ofstream &out) const {
+    PROFILE_SCOPE("TGAImage::unload_rle_data");
     const std::uint8_t max_chunk_length = 128;
     size_t npixels = w * h;
     size_t curpix = 0;
@@ -189,6 +197,13 @@ void TGAImage::set(int x, int y, const TGAColor &c) {
     memcpy(data.data() + (x + y * w) * bpp, c.bgra, bpp);
 }
 
+void TGAImage::fill(const TGAColor &c) {
+    if (!data.size()) return;
+    memcpy(data.data(), c.bgra, bpp);
+    for (size_t filled = bpp; filled < data.size(); filled *= 2) // replicate the first pixel, doubling each time
+        memcpy(data.data() + filled, data.data(), std::min(filled, data.size() - filled));
+}
+
 void TGAImage::flip_horizontally() {
     for (int i = 0; i < w / 2; i++)
         for (int j = 0; j < h; j++)
@@ -210,3 +225,11 @@ int TGAImage::width() const {
 int TGAImage::height() const {
     return h;
 }
+
+int TGAImage::bytespp() const {
+    return bpp;
+}
+
+const std::uint8_t *TGAImage::buffer() const {
+    return data.data();
+}
@@ -58,10 +58,16 @@ struct TGAImage
 
     void set(const int x, const int y, const TGAColor &c); // x,yλôΪɫc
 
+    void fill(const TGAColor &c); // sets every pixel to c, keeps the allocation (used to recycle framebuffers)
+
     int width() const; // ȡͼ
 
     int height() const; // ȡͼ߶
 
+    int bytespp() const; // 1, 3 or 4 once allocated
+
+    const std::uint8_t *buffer() const; // row-major pixels, bytespp() bytes each, for the bulk post-processing passes
+
 private:
     bool load_rle_data(std::ifstream &in);
 